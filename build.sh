@@ -2,15 +2,19 @@ mkdir exect
 cd exect
 rm *
 
-gcc -std=c99 -c ../src/lzma/*.c -D_7ZIP_ST
+gcc -std=c99 -c ../src/lzma/*.c -D_7ZIP_ST -fPIC
 
-g++ -c ../src/*.cpp -std=c++17 -O2 -DNDEBUG -D_FELICITY_CHESS_
-g++ -c ../src/base/*.cpp -std=c++17 -O2 -DNDEBUG -D_FELICITY_CHESS_
-g++ -c ../src/chess/*.cpp -std=c++17 -O2 -DNDEBUG -D_FELICITY_CHESS_
-g++ -c ../src/fegtb/*.cpp -std=c++17 -O2 -DNDEBUG -D_FELICITY_CHESS_
-g++ -c ../src/fegtbgen/*.cpp -std=c++17 -O2 -DNDEBUG -D_FELICITY_CHESS_
+g++ -c ../src/*.cpp -std=c++17 -O2 -DNDEBUG -fPIC -D_FELICITY_CHESS_
+g++ -c ../src/base/*.cpp -std=c++17 -O2 -DNDEBUG -fPIC -D_FELICITY_CHESS_
+g++ -c ../src/chess/*.cpp -std=c++17 -O2 -DNDEBUG -fPIC -D_FELICITY_CHESS_
+g++ -c ../src/fegtb/*.cpp -std=c++17 -O2 -DNDEBUG -fPIC -D_FELICITY_CHESS_
+g++ -c ../src/fegtbgen/*.cpp -std=c++17 -O2 -DNDEBUG -fPIC -D_FELICITY_CHESS_
 
 g++ -o fegtb *.o
+
+# the probe library with its C API (src/fegtb/egtbcapi.h), without the generator
+LIBOBJS=$(cd ../src && for f in lzma/*.c base/*.cpp chess/*.cpp fegtb/*.cpp; do basename ${f%.*}.o; done)
+g++ -shared -o libfegtb.so $LIBOBJS -lpthread
 rm *.o
 cd ..
 ./exect/fegtb
@@ -2,15 +2,19 @@ mkdir exect
 cd exect
 rm *
 
-gcc -std=c99 -c ../src/lzma/*.c -D_7ZIP_ST
+gcc -std=c99 -c ../src/lzma/*.c -D_7ZIP_ST -fPIC
 
-g++ -c ../src/*.cpp -std=c++17 -O2 -DNDEBUG -D_FELICITY_XQ_
-g++ -c ../src/base/*.cpp -std=c++17 -O2 -DNDEBUG -D_FELICITY_XQ_
-g++ -c ../src/xq/*.cpp -std=c++17 -O2 -DNDEBUG -D_FELICITY_XQ_
-g++ -c ../src/fegtb/*.cpp -std=c++17 -O2 -DNDEBUG -D_FELICITY_XQ_
-g++ -c ../src/fegtbgen/*.cpp -std=c++17 -O2 -DNDEBUG -D_FELICITY_XQ_
+g++ -c ../src/*.cpp -std=c++17 -O2 -DNDEBUG -fPIC -D_FELICITY_XQ_
+g++ -c ../src/base/*.cpp -std=c++17 -O2 -DNDEBUG -fPIC -D_FELICITY_XQ_
+g++ -c ../src/xq/*.cpp -std=c++17 -O2 -DNDEBUG -fPIC -D_FELICITY_XQ_
+g++ -c ../src/fegtb/*.cpp -std=c++17 -O2 -DNDEBUG -fPIC -D_FELICITY_XQ_
+g++ -c ../src/fegtbgen/*.cpp -std=c++17 -O2 -DNDEBUG -fPIC -D_FELICITY_XQ_
 
 g++ -o fegtbxq *.o
+
+# the probe library with its C API (src/fegtb/egtbcapi.h), without the generator
+LIBOBJS=$(cd ../src && for f in lzma/*.c base/*.cpp xq/*.cpp fegtb/*.cpp; do basename ${f%.*}.o; done)
+g++ -shared -o libfegtbxq.so $LIBOBJS -lpthread
 rm *.o
 
 cd ..
@@ -59,6 +59,7 @@ ChessBoard::ChessBoard(ChessVariant _variant)
 
 ChessBoard::ChessBoard(const ChessBoard& other)
 {
+    variant = other.variant;
     clone(&other);
 }
 
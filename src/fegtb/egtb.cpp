@@ -20,17 +20,27 @@
 #include <algorithm>
 
 #include "egtb.h"
+#include "../base/funcs.h"
 
 /// for scaning files from a given path
 #ifdef _WIN32
 
 #include <windows.h>
+#include <sys/stat.h>
 
 #else
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
 #include <glob.h>
 #include <dirent.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
 #include <fstream>
 
 #endif
@@ -47,6 +57,8 @@
 namespace fegtb {
 
     bool egtbVerbose = false;
+    bool egtbStats = false;
+    EgtbMemPolicy egtbMemPolicy;
 
     std::string getFileName(const std::string& path) {
         auto pos = path.find_last_of("/\\");
@@ -128,6 +140,279 @@ namespace fegtb {
 
 #endif
 
+    bool getFileInfo(const std::string& path, i64& fileSize, i64& mtime) {
+#ifdef _WIN32
+        struct _stat64 st;
+        if (_stat64(path.c_str(), &st) != 0) {
+            return false;
+        }
+#else
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            return false;
+        }
+#endif
+        fileSize = (i64)st.st_size;
+        mtime = (i64)st.st_mtime;
+        return true;
+    }
+
+#ifdef _WIN32
+    char* mapFile(const std::string& path, i64& size, void** handle) {
+        size = 0;
+        *handle = nullptr;
+
+        auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return nullptr;
+        }
+
+        LARGE_INTEGER fileSize;
+        HANDLE mapping = NULL;
+        if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+            mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        }
+        CloseHandle(file);
+
+        if (mapping == NULL) {
+            return nullptr;
+        }
+
+        auto data = (char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (data == nullptr) {
+            CloseHandle(mapping);
+            return nullptr;
+        }
+
+        size = fileSize.QuadPart;
+        *handle = mapping;
+        return data;
+    }
+
+    void unmapFile(char* data, i64, void* handle) {
+        if (data) {
+            UnmapViewOfFile(data);
+        }
+        if (handle) {
+            CloseHandle((HANDLE)handle);
+        }
+    }
+
+    void* openFileForRead(const std::string& path) {
+        auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+        return file == INVALID_HANDLE_VALUE ? nullptr : (void*)file;
+    }
+
+    bool readFileAt(void* handle, i64 offset, char* buf, i64 sz) {
+        while (sz > 0) {
+            /// the offset in OVERLAPPED makes the read positional, the file pointer is not shared
+            OVERLAPPED overlapped = {};
+            overlapped.Offset = (DWORD)(offset & 0xffffffff);
+            overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+            DWORD cnt = 0;
+            auto n = (DWORD)std::min<i64>(sz, 1 << 30);
+            if (!ReadFile((HANDLE)handle, buf, n, &cnt, &overlapped) || cnt == 0) {
+                return false;
+            }
+            offset += cnt; buf += cnt; sz -= cnt;
+        }
+        return true;
+    }
+
+    void closeFileForRead(void* handle) {
+        if (handle) {
+            CloseHandle((HANDLE)handle);
+        }
+    }
+
+#else
+
+    char* mapFile(const std::string& path, i64& size, void** handle) {
+        size = 0;
+        *handle = nullptr;
+
+        auto fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return nullptr;
+        }
+
+        struct stat st;
+        void* data = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            /// note: "mmap" alone is the name of a memory mode in this namespace
+            data = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd); /// the mapping keeps its own reference to the file
+
+        if (data == MAP_FAILED) {
+            return nullptr;
+        }
+
+        /// probing jumps everywhere, read-ahead would only waste the page cache
+        posix_madvise(data, (size_t)st.st_size, POSIX_MADV_RANDOM);
+
+        size = (i64)st.st_size;
+        return (char*)data;
+    }
+
+    void unmapFile(char* data, i64 size, void*) {
+        if (data) {
+            munmap(data, (size_t)size);
+        }
+    }
+
+    /// handles are file descriptors plus one, so that nullptr means failed
+    void* openFileForRead(const std::string& path) {
+        auto fd = open(path.c_str(), O_RDONLY);
+        return fd < 0 ? nullptr : (void*)(intptr_t)(fd + 1);
+    }
+
+    bool readFileAt(void* handle, i64 offset, char* buf, i64 sz) {
+        auto fd = (int)((intptr_t)handle - 1);
+        while (sz > 0) {
+            auto n = pread(fd, buf, (size_t)sz, (off_t)offset);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            offset += n; buf += n; sz -= n;
+        }
+        return true;
+    }
+
+    void closeFileForRead(void* handle) {
+        if (handle) {
+            close((int)((intptr_t)handle - 1));
+        }
+    }
+
+#endif
+
+    //////////////////////////////////////////////////////////////////////
+    // Large buffers
+    //////////////////////////////////////////////////////////////////////
+
+    /// stored before each buffer, tells how to free it
+    class BufferHeader {
+    public:
+        static const u32 Magic = 0x45474246;
+        static const int Size = 64;
+        enum { byMalloc, byMap, byVirtualAlloc };
+
+        u32 magic;
+        u32 kind;
+        i64 mapSize;
+    };
+
+    static char* initBuffer(char* p, u32 kind, i64 mapSize) {
+        auto header = (BufferHeader*)p;
+        header->magic = BufferHeader::Magic;
+        header->kind = kind;
+        header->mapSize = mapSize;
+        return p + BufferHeader::Size;
+    }
+
+#ifdef __linux__
+    /// nodes from /sys/devices/system/node/online, such as "0-1" or "0,2-3"
+    static u64 getOnlineNumaNodes() {
+        u64 mask = 0;
+        std::ifstream file("/sys/devices/system/node/online");
+        std::string str;
+        if (std::getline(file, str)) {
+            for (auto && s : bslib::Funcs::splitString(str, ',')) {
+                auto p = s.find('-');
+                auto from = std::atoi(s.c_str());
+                auto to = p == std::string::npos ? from : std::atoi(s.c_str() + p + 1);
+                for (auto i = from; i <= to && i < 64; i++) {
+                    mask |= 1ULL << i;
+                }
+            }
+        }
+        return mask;
+    }
+
+    /// set before pages are touched, they are placed when first written
+    static void setNumaPolicy(void* p, i64 sz, int numaNode) {
+        const int mpolBind = 2, mpolInterleave = 3;
+        u64 mask = numaNode == -2 ? getOnlineNumaNodes() : numaNode >= 0 && numaNode < 64 ? 1ULL << numaNode : 0;
+        if (!mask || syscall(SYS_mbind, p, (unsigned long)sz, numaNode == -2 ? mpolInterleave : mpolBind, &mask, 65UL, 0U) != 0) {
+            if (egtbVerbose) {
+                std::cerr << "Warning: cannot set NUMA policy, node " << numaNode << std::endl;
+            }
+        }
+    }
+#endif
+
+    char* allocBuffer(i64 size) {
+        auto policy = egtbMemPolicy;
+        auto sz = size + BufferHeader::Size;
+
+        if (policy.hugePages != EgtbHugePages::none || policy.numaNode != -1) {
+#ifdef _WIN32
+            if (policy.hugePages == EgtbHugePages::reserved && GetLargePageMinimum() > 0) {
+                i64 pageSz = GetLargePageMinimum();
+                auto mapSz = (sz + pageSz - 1) / pageSz * pageSz;
+                auto p = (char*)VirtualAlloc(nullptr, (SIZE_T)mapSz, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+                if (p) {
+                    return initBuffer(p, BufferHeader::byVirtualAlloc, mapSz);
+                }
+            }
+#elif defined(__linux__)
+            const i64 hugePageSz = 2 * 1024 * 1024L;
+            auto mapSz = (sz + hugePageSz - 1) / hugePageSz * hugePageSz;
+            auto p = MAP_FAILED;
+            if (policy.hugePages == EgtbHugePages::reserved) {
+                p = ::mmap(nullptr, (size_t)mapSz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            }
+            if (p == MAP_FAILED) {
+                p = ::mmap(nullptr, (size_t)mapSz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (p != MAP_FAILED && policy.hugePages != EgtbHugePages::none) {
+                    madvise(p, (size_t)mapSz, MADV_HUGEPAGE);
+                }
+            }
+            if (p != MAP_FAILED) {
+                if (policy.numaNode != -1) {
+                    setNumaPolicy(p, mapSz, policy.numaNode);
+                }
+                return initBuffer((char*)p, BufferHeader::byMap, mapSz);
+            }
+#endif
+            if (egtbVerbose) {
+                std::cerr << "Warning: cannot allocate huge pages / NUMA memory, use malloc" << std::endl;
+            }
+        }
+
+        auto p = (char*)malloc((size_t)sz);
+        return p ? initBuffer(p, BufferHeader::byMalloc, 0) : nullptr;
+    }
+
+    void freeBuffer(char* buf) {
+        if (buf == nullptr) {
+            return;
+        }
+
+        auto p = buf - BufferHeader::Size;
+        auto header = (BufferHeader*)p;
+        assert(header->magic == BufferHeader::Magic);
+        switch (header->kind) {
+#ifdef _WIN32
+            case BufferHeader::byVirtualAlloc:
+                VirtualFree(p, 0, MEM_RELEASE);
+                break;
+#elif defined(__linux__)
+            case BufferHeader::byMap:
+                munmap(p, (size_t)header->mapSize);
+                break;
+#endif
+            default:
+                free(p);
+                break;
+        }
+    }
+
     static void * _allocForLzma(ISzAllocPtr, size_t size) { return malloc(size); }
     static void _freeForLzma(ISzAllocPtr, void *addr) { free(addr); }
     static ISzAlloc _szAllocForLzma = { _allocForLzma, _freeForLzma };
@@ -148,6 +433,96 @@ namespace fegtb {
         return res == SZ_OK ? (int)dstLen : -1;
     }
 
+    int decompress(char *dst, int uncompresslen, const char *src, int slen, EgtbCodec codec) {
+        switch (codec) {
+            case EgtbCodec::lz:
+                return decompressLz(dst, uncompresslen, src, slen);
+            case EgtbCodec::lzma:
+                return decompress(dst, uncompresslen, src, slen);
+            default:
+                /// grammar blocks need their grammars, see EgtbFile
+                return -1;
+        }
+    }
+
+    static inline bool readLzLength(const u8*& s, const u8* sEnd, int& len) {
+        for(;;) {
+            if (s >= sEnd) {
+                return false;
+            }
+            auto k = *s++;
+            len += k;
+            if (k != 255) {
+                return true;
+            }
+        }
+    }
+
+    int decompressLz(char *dst, int uncompresslen, const char *src, int slen, const char* dict, int dictLen) {
+        auto s = (const u8*)src, sEnd = s + slen;
+        auto d = (u8*)dst, dEnd = d + uncompresslen;
+
+        while (s < sEnd) {
+            int token = *s++;
+
+            int litLen = token >> 4;
+            if (litLen == 15 && !readLzLength(s, sEnd, litLen)) {
+                return -1;
+            }
+            if (litLen > sEnd - s || litLen > dEnd - d) {
+                return -1;
+            }
+            memcpy(d, s, litLen);
+            d += litLen; s += litLen;
+
+            /// the last token has no match
+            if (s == sEnd) {
+                break;
+            }
+
+            if (sEnd - s < 2) {
+                return -1;
+            }
+            int offset = s[0] | (s[1] << 8);
+            s += 2;
+
+            int matchLen = token & 15;
+            if (matchLen == 15 && !readLzLength(s, sEnd, matchLen)) {
+                return -1;
+            }
+            matchLen += EGTB_LZ_MIN_MATCH;
+
+            auto produced = (int)(d - (u8*)dst);
+            if (offset == 0 || offset > produced + dictLen || matchLen > dEnd - d) {
+                return -1;
+            }
+
+            /// starting in the dictionary, may continue in the block
+            if (offset > produced) {
+                auto n = std::min(matchLen, offset - produced);
+                memcpy(d, dict + dictLen - (offset - produced), n);
+                d += n;
+                matchLen -= n;
+                if (matchLen == 0) {
+                    continue;
+                }
+            }
+
+            auto m = d - offset;
+            if (offset >= matchLen) {
+                memcpy(d, m, matchLen);
+                d += matchLen;
+            } else {
+                /// overlapped, repeated pattern
+                for(auto e = d + matchLen; d < e; ) {
+                    *d++ = *m++;
+                }
+            }
+        }
+
+        return (int)(d - (u8*)dst);
+    }
+
     i64 decompressAllBlocks(int blocksize, int blocknum, u32* blocktable, char *dest, i64 uncompressedlen, const char *src, i64 slen) {
         auto *s = src;
         auto p = dest;
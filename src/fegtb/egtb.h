@@ -90,6 +90,12 @@ const static int COPYRIGHT_BUFSZ = 64;
 
 #define TB_RANGE_1_BYTE                     124
 
+/// 2-bit cells of WDL tables, 4 cells per byte, the first one in the lowest bits
+#define TB_WDL_DRAW                         0
+#define TB_WDL_WIN                          1
+#define TB_WDL_LOSS                         2
+#define TB_WDL_ILLEGAL                      3
+
 //////////////////////////////////////////////////////////////////////
 
 #define EGTB_SCORE_DRAW                         0
@@ -100,6 +106,11 @@ const static int COPYRIGHT_BUFSZ = 64;
 #define EGTB_SCORE_MISSING                      1006
 #define EGTB_SCORE_UNSET                        1007
 
+/// results of WDL probes
+#define EGTB_WDL_LOSS                           (-1)
+#define EGTB_WDL_DRAW                           0
+#define EGTB_WDL_WIN                            1
+
 
 //////////////////////////////////////////////////////////////////////
 
@@ -115,7 +126,8 @@ const static int COPYRIGHT_BUFSZ = 64;
     enum EgtbMemMode {
         tiny,          // load minimum to memory
         all,            // load all data into memory, no access hard disk after loading
-        smart           // depend on data size, load as small or all mode
+        smart,          // depend on data size, load as small or all mode
+        mmap            // map files into memory, data is shared via the OS page cache
     };
 
     enum EgtbLoadMode {
@@ -128,19 +140,76 @@ const static int COPYRIGHT_BUFSZ = 64;
     };
 
     enum class EgtbType {
-        dtm, tmp, none
+        dtm, tmp, wdl, none
     };
 
     std::string getFileName(const std::string& path);
     std::string getVersion();
     std::vector<std::string> listdir(std::string dirname);
 
+    /// size and last modified time (seconds) of a file or folder, false if it doesn't exist
+    bool getFileInfo(const std::string& path, i64& fileSize, i64& mtime);
+
+    /// codecs of compressed blocks. lz is a byte-oriented LZ77 codec without an entropy stage,
+    /// its files are larger than lzma ones but their blocks are decoded several times faster.
+    /// grammar codes symbols of a static pair-substitution grammar with canonical Huffman codes,
+    /// an item can be read by walking codes of its block, without decompressing the block
+    enum class EgtbCodec {
+        lzma, lz, grammar
+    };
+
     int decompress(char *dst, int uncompresslen, const char *src, int slen);
+    int decompress(char *dst, int uncompresslen, const char *src, int slen, EgtbCodec codec);
+
+    /*
+     * lz block format: a sequence of tokens, each token is a byte with the number of literals
+     * in its high nibble and the match length (minus EGTB_LZ_MIN_MATCH) in its low nibble.
+     * A nibble of 15 is followed by extra bytes, added to it until one of them is not 255.
+     * After the token come the literals then a 2-byte (little endian) offset of the match.
+     * The last token of a block has only literals. An optional dictionary is treated as
+     * data preceding the block, matches can start in it
+     */
+    const int EGTB_LZ_MIN_MATCH = 4;
+    const int EGTB_LZ_MAX_DICT_SIZE = 32 * 1024;
+    int decompressLz(char *dst, int uncompresslen, const char *src, int slen, const char* dict = nullptr, int dictLen = 0);
     i64 decompressAllBlocks(int blocksize, int blocknum, u32* blocktable, char *dest, i64 uncompressedlen, const char *src, i64 slen);
 
+    /// map a whole file into memory for reading, return nullptr if failed
+    char* mapFile(const std::string& path, i64& size, void** handle);
+    void unmapFile(char* data, i64 size, void* handle);
+
+    /// open a file for positional reads, those reads can be issued by many threads at the same time
+    void* openFileForRead(const std::string& path);
+    bool readFileAt(void* handle, i64 offset, char* buf, i64 sz);
+    void closeFileForRead(void* handle);
+
+    enum class EgtbHugePages {
+        none,
+        transparent,    /// advise the kernel to back buffers by huge pages
+        reserved        /// pages from the reserved pool (hugetlbfs / large pages), transparent ones if failed
+    };
+
+    /// placement of large buffers: all mode data of probing, buffers and flags of generating
+    class EgtbMemPolicy {
+    public:
+        EgtbHugePages hugePages = EgtbHugePages::none;
+
+        /// NUMA: -1 system default, -2 interleave over all nodes, otherwise bind to that node
+        int numaNode = -1;
+    };
+    extern EgtbMemPolicy egtbMemPolicy;
+
+    /// allocate/free a large buffer by egtbMemPolicy, it falls back to malloc when a request
+    /// can't be met. Buffers must be freed by freeBuffer
+    char* allocBuffer(i64 size);
+    void freeBuffer(char* buf);
+
     /// set it to true if you want to print out more messages
     extern bool egtbVerbose;
 
+    /// set it to true to collect counters of probing (EgtbDb::getStatsJson)
+    extern bool egtbStats;
+
     class EgtbFile;
     class EgtbDb;
     class EgtbKeyRec;
@@ -337,6 +406,7 @@ enum EgtbIdx {
 
 } // namespace fegtb
 
+#include "egtbcache.h"
 #include "egtbfile.h"
 #include "egtbdb.h"
 #include "egtbkey.h"
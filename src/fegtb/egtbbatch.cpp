@@ -0,0 +1,457 @@
+/**
+ This file is part of Felicity Egtb, distributed under MIT license.
+
+ * Copyright (c) 2024 Nguyen Hong Pham (github@nguyenpham)
+ * Copyright (c) 2024 developers
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ */
+
+
+
+#include <iostream>
+#include <chrono>
+#include <deque>
+#include <array>
+#include <cctype>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#include "egtbbatch.h"
+#include "egtbpool.h"
+
+#include "../base/funcs.h"
+
+using namespace fegtb;
+using namespace bslib;
+
+EgtbBatchProber::EgtbBatchProber(EgtbDb& egtbDb)
+: egtbDb(egtbDb)
+{
+    threadCnt = std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+bool EgtbBatchProber::parseFen(EgtbBoard& board, const char* str, int len)
+{
+    /// piece types of FEN letters, | 8 for white ones, -1 for others
+    static const auto pieceTable = [] {
+        std::array<int8_t, 256> table;
+        table.fill(-1);
+        for (size_t i = 1; i < Funcs::pieceTypeName.size(); i++) {
+            auto ch = (u8)Funcs::pieceTypeName[i];
+            table[ch] = (int8_t)i;
+            table[ch - 'a' + 'A'] = (int8_t)(i | 8);
+        }
+        return table;
+    }();
+
+    board.reset();
+
+    auto colCnt = board.columnCount(), rowCnt = board.rankCount();
+    auto p = str, end = str + len;
+    while (p < end && *p == ' ') {
+        p++;
+    }
+
+    auto row = 0, col = 0;
+    for (; p < end && *p != ' '; p++) {
+        auto ch = (u8)*p;
+        if (ch == '/') {
+            if (col != colCnt || ++row >= rowCnt) {
+                return false;
+            }
+            col = 0;
+            continue;
+        }
+
+        if (ch >= '1' && ch <= '9') {
+            col += ch - '0';
+            if (col > colCnt) {
+                return false;
+            }
+            continue;
+        }
+
+        auto k = pieceTable[ch];
+        if (k < 0 || col >= colCnt) {
+            return false;
+        }
+        board.setPiece(row * colCnt + col, Piece(static_cast<PieceType>(k & 7), (k & 8) ? Side::white : Side::black));
+        col++;
+    }
+
+    if (row != rowCnt - 1 || col != colCnt) {
+        return false;
+    }
+
+    while (p < end && *p == ' ') {
+        p++;
+    }
+    if (p < end) {
+        switch (*p) {
+            case 'w': case 'W': case 'r': case 'R':
+                board.side = Side::white;
+                break;
+            case 'b': case 'B':
+                board.side = Side::black;
+                break;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+int EgtbBatchProber::getPositionSize(const u8* p, i64 avail)
+{
+    if (avail < 1) {
+        return 0;
+    }
+
+    switch (static_cast<EgtbPositionFormat>(p[0])) {
+        case EgtbPositionFormat::fen:
+            return avail < 4 ? 0 : 4 + (p[2] | (p[3] << 8));
+        case EgtbPositionFormat::compact:
+            return avail < 3 ? 0 : 3 + 2 * p[2];
+        default:
+            return -1;
+    }
+}
+
+bool EgtbBatchProber::setupBoard(EgtbBoard& board, const u8* p)
+{
+    auto sd = p[1];
+
+    switch (static_cast<EgtbPositionFormat>(p[0])) {
+        case EgtbPositionFormat::fen: {
+            auto len = p[2] | (p[3] << 8);
+            if (len == 0 || sd > 2 || !parseFen(board, (const char*)p + 4, len)) {
+                return false;
+            }
+            if (sd < 2) {
+                board.side = static_cast<Side>(sd);
+            }
+            break;
+        }
+
+        case EgtbPositionFormat::compact: {
+            auto cnt = p[2];
+            if (sd > 1 || cnt > 32) {
+                return false;
+            }
+
+            board.reset();
+            auto items = p + 3;
+            for (auto i = 0; i < cnt; i++) {
+                auto type = items[2 * i] & 0xf, pieceSd = items[2 * i] >> 4, pos = (int)items[2 * i + 1];
+                if (type == 0 || type > PAWN || pieceSd > 1 || pos >= BOARD_SZ || !board.isEmpty(pos)) {
+                    return false;
+                }
+                board.setPiece(pos, Piece(static_cast<PieceType>(type), static_cast<Side>(pieceSd)));
+            }
+            board.side = static_cast<Side>(sd);
+            break;
+        }
+
+        default:
+            return false;
+    }
+
+    return board.side != Side::none && board.isValid();
+}
+
+/// Read whole lines / positions, the rest is kept for the next chunk
+bool EgtbBatchProber::readChunk(FILE* inFile, EgtbBatchFormat inFormat, Chunk& chunk)
+{
+    auto& data = chunk.data;
+    data.swap(carry);
+    carry.clear();
+
+    size_t want = ChunkSize, end = 0;
+    while (true) {
+        auto oldSz = data.size();
+        if (!inputEnd && oldSz < want) {
+            data.resize(want);
+            auto n = fread(data.data() + oldSz, 1, want - oldSz, inFile);
+            data.resize(oldSz + n);
+            inputEnd = n < want - oldSz;
+        }
+
+        end = 0;
+        if (inFormat == EgtbBatchFormat::text) {
+            if (inputEnd) {
+                end = data.size();
+            } else {
+                for (auto i = data.size(); i > 0; i--) {
+                    if (data[i - 1] == '\n') {
+                        end = i;
+                        break;
+                    }
+                }
+            }
+        } else {
+            auto p = (const u8*)data.data();
+            while (true) {
+                auto sz = getPositionSize(p + end, (i64)(data.size() - end));
+                if (sz < 0) {
+                    std::cerr << "Error: unknown position format in input" << std::endl;
+                    inputError = inputEnd = true;
+                    data.resize(end);
+                    break;
+                }
+                if (sz == 0 || end + sz > data.size()) {
+                    break;
+                }
+                end += sz;
+            }
+
+            if (inputEnd && end < data.size()) {
+                std::cerr << "Error: input ends in the middle of a position" << std::endl;
+                inputError = true;
+            }
+        }
+
+        if (end > 0 || inputEnd) {
+            break;
+        }
+
+        /// a line / position longer than a chunk
+        want = data.size() + ChunkSize;
+    }
+
+    if (!inputEnd) {
+        carry.assign(data.begin() + end, data.end());
+    }
+    data.resize(end);
+    return !data.empty();
+}
+
+void EgtbBatchProber::probeChunk(Chunk& chunk, EgtbBatchFormat inFormat, EgtbBatchFormat outFormat)
+{
+    /// reused by chunks of the thread
+    static thread_local std::vector<EgtbBoard> boards;
+    static thread_local std::vector<int> boardIdxs, scores, probedScores;
+    static thread_local std::vector<std::pair<size_t, int>> fenVec;
+
+    boardIdxs.clear();
+    fenVec.clear();
+
+    auto data = chunk.data.data();
+    auto sz = chunk.data.size();
+    auto cnt = 0, boardCnt = 0;
+
+    for (size_t i = 0; i < sz; cnt++) {
+        if ((int)boards.size() <= boardCnt) {
+            boards.resize(boards.size() * 2 + 64);
+        }
+        auto& board = boards[boardCnt];
+        auto valid = false;
+
+        if (inFormat == EgtbBatchFormat::text) {
+            auto p = (const char*)memchr(data + i, '\n', sz - i);
+            auto lineEnd = p ? (size_t)(p - data) : sz;
+            auto s = i, t = lineEnd;
+            i = lineEnd + 1;
+
+            while (s < t && isspace((u8)data[s])) {
+                s++;
+            }
+            while (t > s && isspace((u8)data[t - 1])) {
+                t--;
+            }
+            if (s == t) {
+                cnt--;
+                continue;
+            }
+
+            fenVec.push_back(std::make_pair(s, (int)(t - s)));
+            valid = parseFen(board, data + s, (int)(t - s)) && board.side != Side::none && board.isValid();
+        } else {
+            auto n = getPositionSize((const u8*)data + i, (i64)(sz - i));
+            valid = setupBoard(board, (const u8*)data + i);
+            i += n;
+        }
+
+        if (valid) {
+            boardIdxs.push_back(cnt);
+            boardCnt++;
+        }
+    }
+
+    scores.assign(cnt, EGTB_SCORE_MISSING);
+    if (boardCnt > 0) {
+        probedScores.resize(boardCnt);
+        egtbDb.getScores(boards.data(), boardCnt, probedScores.data());
+        for (auto j = 0; j < boardCnt; j++) {
+            scores[boardIdxs[j]] = probedScores[j];
+        }
+    }
+
+    auto& out = chunk.out;
+    if (outFormat == EgtbBatchFormat::binary) {
+        out.assign((const char*)scores.data(), cnt * sizeof(int));
+    } else {
+        out.reserve(sz + cnt * 16);
+        for (auto k = 0, j = 0; k < cnt; k++) {
+            if (inFormat == EgtbBatchFormat::text) {
+                /// quoted if it has commas, such as some EPD operations
+                auto fen = data + fenVec[k].first;
+                auto len = fenVec[k].second;
+                if (memchr(fen, ',', len) || memchr(fen, '"', len)) {
+                    out += '"';
+                    for (auto i = 0; i < len; i++) {
+                        if (fen[i] == '"') {
+                            out += '"';
+                        }
+                        out += fen[i];
+                    }
+                    out += '"';
+                } else {
+                    out.append(fen, len);
+                }
+            } else if (j < boardCnt && boardIdxs[j] == k) {
+                out += boards[j].getFen();
+            }
+
+            if (j < boardCnt && boardIdxs[j] == k) {
+                j++;
+            }
+
+            char buf[32];
+            auto n = snprintf(buf, sizeof(buf), ",%d,%d\n", scores[k], EgtbFile::scoreToWDL(scores[k]));
+            out.append(buf, n);
+        }
+    }
+
+    auto found = 0;
+    for (auto k = 0; k < cnt; k++) {
+        found += scores[k] != EGTB_SCORE_MISSING;
+    }
+    positionCnt += cnt;
+    validCnt += boardCnt;
+    foundCnt += found;
+
+    {
+        std::lock_guard<std::mutex> thelock(doneMutex);
+        chunk.done = true;
+    }
+    doneCv.notify_all();
+}
+
+bool EgtbBatchProber::run(const std::string& inPath, EgtbBatchFormat inFormat, const std::string& outPath, EgtbBatchFormat outFormat)
+{
+    auto startTime = std::chrono::steady_clock::now();
+
+    positionCnt = validCnt = foundCnt = 0;
+    carry.clear();
+    inputEnd = inputError = false;
+
+#ifdef _WIN32
+    if (inPath == "-") {
+        _setmode(_fileno(stdin), _O_BINARY);
+    }
+    if (outPath == "-") {
+        _setmode(_fileno(stdout), _O_BINARY);
+    }
+#endif
+
+    auto inFile = inPath == "-" ? stdin : fopen(inPath.c_str(), "rb");
+    if (!inFile) {
+        std::cerr << "Error: cannot open " << inPath << std::endl;
+        return false;
+    }
+    auto outFile = outPath == "-" ? stdout : fopen(outPath.c_str(), "wb");
+    if (!outFile) {
+        std::cerr << "Error: cannot create " << outPath << std::endl;
+        if (inFile != stdin) {
+            fclose(inFile);
+        }
+        return false;
+    }
+
+    auto ok = true;
+    if (outFormat == EgtbBatchFormat::text) {
+        ok = fputs("fen,score,wdl\n", outFile) >= 0;
+    }
+
+    /// chunks in input order, waiting to be written
+    std::deque<std::shared_ptr<Chunk>> pending;
+    auto maxPending = 2 * threadCnt + 2;
+
+    auto isFrontDone = [&]() {
+        std::lock_guard<std::mutex> thelock(doneMutex);
+        return pending.front()->done;
+    };
+
+    auto writeFront = [&]() {
+        auto chunk = pending.front();
+        {
+            std::unique_lock<std::mutex> thelock(doneMutex);
+            doneCv.wait(thelock, [&] { return chunk->done; });
+        }
+        pending.pop_front();
+
+        if (ok && !chunk->out.empty() && fwrite(chunk->out.data(), 1, chunk->out.size(), outFile) != chunk->out.size()) {
+            std::cerr << "Error: cannot write " << outPath << std::endl;
+            ok = false;
+        }
+    };
+
+    {
+        EgtbThreadPool pool(threadCnt);
+
+        while (ok) {
+            auto chunk = std::make_shared<Chunk>();
+            if (!readChunk(inFile, inFormat, *chunk)) {
+                break;
+            }
+
+            while ((int)pending.size() >= maxPending) {
+                writeFront();
+            }
+            pending.push_back(chunk);
+
+            std::function<void()> job = [this, chunk, inFormat, outFormat]() {
+                probeChunk(*chunk, inFormat, outFormat);
+            };
+            if (!pool.submit(job)) {
+                job();
+            }
+
+            while (!pending.empty() && isFrontDone()) {
+                writeFront();
+            }
+        }
+
+        while (!pending.empty()) {
+            writeFront();
+        }
+    }
+
+    if (inFile != stdin) {
+        fclose(inFile);
+    }
+    if (outFile != stdout) {
+        ok = fclose(outFile) == 0 && ok;
+    } else {
+        fflush(outFile);
+    }
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    std::cout << "Batch probe: " << positionCnt << " positions (valid: " << validCnt << ", found: " << foundCnt << ")"
+              << ", " << elapsed << " s, " << (i64)(positionCnt / std::max(elapsed, 1e-9)) << " positions/s" << std::endl;
+
+    return ok && !inputError;
+}
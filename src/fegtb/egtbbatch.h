@@ -0,0 +1,113 @@
+/**
+ This file is part of Felicity Egtb, distributed under MIT license.
+
+ * Copyright (c) 2024 Nguyen Hong Pham (github@nguyenpham)
+ * Copyright (c) 2024 developers
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ */
+
+
+
+#ifndef fegtb_batch_h
+#define fegtb_batch_h
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "egtbdb.h"
+
+namespace fegtb {
+
+/*
+ * Probes files of positions in parallel, such as for labelling training positions. The calling
+ * thread reads chunks of the input and writes their results in input order, worker threads parse
+ * and probe chunks. Positions of a chunk are probed by EgtbDb::getScores, thus they are grouped by
+ * table and block.
+ *
+ * Input is a text file of FEN/EPD lines (empty lines are skipped) or a binary file of positions in
+ * the format of the probe server (EgtbServer) requests, without request headers.
+ * Output is CSV (fen,score,wdl) or binary, an i32 score for each position. Invalid positions
+ * get EGTB_SCORE_MISSING
+ */
+enum class EgtbBatchFormat {
+    text, binary
+};
+
+/// formats of positions in the binary format, see EgtbServer
+enum class EgtbPositionFormat {
+    fen, compact
+};
+
+class EgtbBatchProber {
+public:
+    /// bytes of input per chunk
+    static const int ChunkSize = 1 << 20;
+
+    EgtbBatchProber(EgtbDb& egtbDb);
+
+    /// Number of worker threads, 0 to probe in the calling thread
+    void setThreadCount(int n) {
+        threadCnt = std::max(0, n);
+    }
+
+    /// Paths may be - for stdin/stdout. Return false if failed to open or write
+    bool run(const std::string& inPath, EgtbBatchFormat inFormat, const std::string& outPath, EgtbBatchFormat outFormat);
+
+    /// Counters of the last run
+    i64 getPositionCount() const { return positionCnt; }
+    i64 getValidCount() const { return validCnt; }
+    i64 getFoundCount() const { return foundCnt; }
+
+    /// Setup a board from the placement and side fields of a FEN/EPD, other fields are ignored.
+    /// Side is Side::none if its field is missing. Return false if the placement is malformed
+    static bool parseFen(EgtbBoard& board, const char* str, int len);
+
+    /// Size of the position (in the binary format) at p, known from its first avail bytes.
+    /// 0 if they are too few to tell, -1 for unknown formats
+    static int getPositionSize(const u8* p, i64 avail);
+
+    /// Setup a board from a whole position in the binary format, false if it is invalid
+    static bool setupBoard(EgtbBoard& board, const u8* p);
+
+private:
+    class Chunk {
+    public:
+        std::vector<char> data;
+        std::string out;
+        bool done = false;
+    };
+
+    bool    readChunk(FILE* inFile, EgtbBatchFormat inFormat, Chunk& chunk);
+    void    probeChunk(Chunk& chunk, EgtbBatchFormat inFormat, EgtbBatchFormat outFormat);
+
+    EgtbDb& egtbDb;
+    int threadCnt;
+
+    /// input read but not yet in a chunk
+    std::vector<char> carry;
+    bool inputEnd = false, inputError = false;
+
+    std::mutex doneMutex;
+    std::condition_variable doneCv;
+
+    std::atomic<i64> positionCnt { 0 }, validCnt { 0 }, foundCnt { 0 };
+};
+
+} // namespace fegtb
+
+#endif /* fegtb_batch_h */
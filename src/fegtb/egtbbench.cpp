@@ -0,0 +1,256 @@
+/**
+ This file is part of Felicity Egtb, distributed under MIT license.
+
+ * Copyright (c) 2024 Nguyen Hong Pham (github@nguyenpham)
+ * Copyright (c) 2024 developers
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ */
+
+
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+
+#include "egtbbench.h"
+#include "egtbbatch.h"
+
+using namespace fegtb;
+using namespace bslib;
+
+bool EgtbProbeBench::createWorkload(int positionsPerTable, u64 seed)
+{
+    boards.clear();
+    tableIdxs.clear();
+    tableNames.clear();
+
+    EgtbDb egtbDb;
+    egtbDb.preload(folder, EgtbMemMode::tiny);
+
+    /// the order of files in folders may vary
+    auto fileVec = egtbDb.egtbFileVec;
+    std::sort(fileVec.begin(), fileVec.end(), [](const EgtbFile* a, const EgtbFile* b) {
+        return a->getName() < b->getName();
+    });
+
+    /// not std::uniform_int_distribution nor std::shuffle, their results depend on the library
+    std::mt19937_64 rng(seed);
+
+    EgtbBoard board;
+    for (auto && pEgtbFile : fileVec) {
+        pEgtbFile->checkToLoadHeaderAndTables(Side::none);
+        if (pEgtbFile->getLoadStatus() == EgtbLoadStatus::error || pEgtbFile->getSize() <= 0) {
+            continue;
+        }
+
+        auto tableIdx = (int)tableNames.size();
+        tableNames.push_back(pEgtbFile->getName());
+
+        auto cnt = 0;
+        for (i64 tryCnt = 0; cnt < positionsPerTable && tryCnt < 64LL * positionsPerTable; tryCnt++) {
+            auto idx = (i64)(rng() % (u64)pEgtbFile->getSize());
+            auto side = (rng() & 1) ? Side::white : Side::black;
+            if (!pEgtbFile->setupBoard(board, idx, FlipMode::none, Side::white) || !board.isValid()) {
+                continue;
+            }
+            board.side = side;
+            if (board.isIncheck(getXSide(side))) {
+                continue;
+            }
+            boards.push_back(board);
+            tableIdxs.push_back(tableIdx);
+            cnt++;
+        }
+    }
+
+    /// probes go from table to table as in searching
+    for (auto i = (i64)boards.size() - 1; i > 0; i--) {
+        auto j = (i64)(rng() % (u64)(i + 1));
+        std::swap(boards[i], boards[j]);
+        std::swap(tableIdxs[i], tableIdxs[j]);
+    }
+
+    if (boards.empty()) {
+        std::cerr << "Error: no positions for benchmark from " << folder << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool EgtbProbeBench::loadWorkload(const std::string& path)
+{
+    boards.clear();
+    tableIdxs.clear();
+    tableNames.clear();
+
+    std::ifstream inFile(path);
+    if (!inFile) {
+        std::cerr << "Error: cannot open " << path << std::endl;
+        return false;
+    }
+
+    EgtbDb egtbDb;
+    egtbDb.preload(folder, EgtbMemMode::tiny);
+
+    std::map<std::string, int> nameMap;
+    std::string line;
+    EgtbBoard board;
+    auto droppedCnt = 0;
+    while (std::getline(inFile, line)) {
+        if (!EgtbBatchProber::parseFen(board, line.c_str(), (int)line.size())
+            || board.side == Side::none || !board.isValid()) {
+            continue;
+        }
+
+        auto pEgtbFile = egtbDb.getEgtbFile(board);
+        if (!pEgtbFile) {
+            droppedCnt++;
+            continue;
+        }
+
+        auto it = nameMap.find(pEgtbFile->getName());
+        if (it == nameMap.end()) {
+            it = nameMap.insert(std::make_pair(pEgtbFile->getName(), (int)tableNames.size())).first;
+            tableNames.push_back(pEgtbFile->getName());
+        }
+        boards.push_back(board);
+        tableIdxs.push_back(it->second);
+    }
+
+    if (droppedCnt > 0) {
+        std::cout << "Dropped " << droppedCnt << " positions without tables" << std::endl;
+    }
+    if (boards.empty()) {
+        std::cerr << "Error: no positions for benchmark from " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void EgtbProbeBench::runPass(EgtbDb& egtbDb, int threadCnt, Result& result) const
+{
+    std::vector<Result> threadResults(threadCnt);
+
+    auto work = [&](int t) {
+        auto& r = threadResults[t];
+        r.latencyVec.resize(tableNames.size());
+
+        auto from = boards.size() * t / threadCnt, to = boards.size() * (t + 1) / threadCnt;
+        for (auto i = from; i < to; i++) {
+            auto startTime = std::chrono::steady_clock::now();
+            int score;
+            /// as getScore but quiet for missing ones
+            egtbDb.getScores(&boards[i], 1, &score);
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+            r.latencyVec[tableIdxs[i]].push_back((u32)std::min<i64>(ns, UINT32_MAX));
+            r.missingCnt += score == EGTB_SCORE_MISSING;
+        }
+    };
+
+    auto startTime = std::chrono::steady_clock::now();
+    {
+        std::vector<std::thread> threadVec;
+        for (auto t = 1; t < threadCnt; t++) {
+            threadVec.push_back(std::thread(work, t));
+        }
+        work(0);
+        for (auto && t : threadVec) {
+            t.join();
+        }
+    }
+
+    result = Result();
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    result.latencyVec.resize(tableNames.size());
+    for (auto && r : threadResults) {
+        result.missingCnt += r.missingCnt;
+        for (size_t k = 0; k < tableNames.size(); k++) {
+            auto& vec = result.latencyVec[k];
+            vec.insert(vec.end(), r.latencyVec[k].begin(), r.latencyVec[k].end());
+        }
+    }
+}
+
+void EgtbProbeBench::printResult(const std::string& title, const Result& result) const
+{
+    auto printLatencies = [](std::vector<u32>& vec) {
+        std::sort(vec.begin(), vec.end());
+        for (auto && q : { 0.5, 0.99, 0.999 }) {
+            auto k = std::min(vec.size() - 1, (size_t)(q * vec.size()));
+            std::cout << std::setw(11) << std::fixed << std::setprecision(2) << vec[k] / 1000.0;
+        }
+    };
+
+    std::vector<u32> allVec;
+    for (auto && vec : result.latencyVec) {
+        allVec.insert(allVec.end(), vec.begin(), vec.end());
+    }
+
+    std::cout << title
+              << std::setw(12) << (i64)(boards.size() / std::max(result.seconds, 1e-9));
+    printLatencies(allVec);
+    std::cout << std::setw(9) << result.missingCnt << std::endl;
+
+    for (size_t k = 0; k < tableNames.size(); k++) {
+        auto vec = result.latencyVec[k];
+        if (vec.empty()) {
+            continue;
+        }
+        std::cout << "    " << std::left << std::setw(20) << tableNames[k] << std::right << std::setw(12) << vec.size();
+        printLatencies(vec);
+        std::cout << std::endl;
+    }
+}
+
+void EgtbProbeBench::run(int maxThreads)
+{
+    std::vector<int> threadCntVec;
+    for (auto n = 1; n < maxThreads; n *= 2) {
+        threadCntVec.push_back(n);
+    }
+    threadCntVec.push_back(std::max(1, maxThreads));
+
+    const std::vector<std::pair<EgtbMemMode, std::string>> modeVec {
+        { EgtbMemMode::tiny, "tiny" }, { EgtbMemMode::all, "all" }, { EgtbMemMode::smart, "smart" }, { EgtbMemMode::mmap, "mmap" }
+    };
+
+    std::cout << "Probe benchmark: " << boards.size() << " positions of " << tableNames.size() << " tables from " << folder << std::endl;
+    std::cout << "mode   threads  cache    probes/s     p50 us     p99 us    p999 us  missing" << std::endl;
+    std::cout << "    table                     probes" << std::endl;
+
+    for (auto && mode : modeVec) {
+        for (auto && threadCnt : threadCntVec) {
+            /// cold: blocks of earlier runs must not be found
+            egtbBlockCache.clear();
+
+            EgtbDb egtbDb;
+            egtbDb.preload(folder, mode.first);
+
+            for (auto warm = 0; warm < 2; warm++) {
+                Result result;
+                runPass(egtbDb, threadCnt, result);
+
+                std::ostringstream stringStream;
+                stringStream << std::left << std::setw(6) << mode.second << std::right << std::setw(8) << threadCnt
+                             << "  " << (warm ? "warm" : "cold") << " ";
+                printResult(stringStream.str(), result);
+            }
+        }
+    }
+}
@@ -0,0 +1,78 @@
+/**
+ This file is part of Felicity Egtb, distributed under MIT license.
+
+ * Copyright (c) 2024 Nguyen Hong Pham (github@nguyenpham)
+ * Copyright (c) 2024 developers
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ */
+
+
+
+#ifndef fegtb_bench_h
+#define fegtb_bench_h
+
+#include <string>
+#include <vector>
+
+#include "egtbdb.h"
+
+namespace fegtb {
+
+/*
+ * A benchmark of probing, for comparing memory modes and changes of the probe code. A workload
+ * (random positions of the tables of a folder or positions of a FEN/EPD file) is probed under all
+ * memory modes with 1, 2, 4 ... threads, on cold caches (just after preloading) then on warm ones.
+ * Each probe is timed, the report has probes per second and p50 / p99 / p999 latencies of all
+ * positions and of each table. Random workloads are the same for the same seed
+ */
+class EgtbProbeBench {
+public:
+    static const int DefaultPositionsPerTable = 10000;
+    static const u64 DefaultSeed = 1;
+
+    EgtbProbeBench(const std::string& folder) : folder(folder) {}
+
+    /// Uniformly random legal positions of each table of the folder
+    bool createWorkload(int positionsPerTable, u64 seed = DefaultSeed);
+
+    /// Positions of a FEN/EPD file, ones without tables are dropped
+    bool loadWorkload(const std::string& path);
+
+    int getSize() const {
+        return (int)boards.size();
+    }
+
+    /// Run the workload under all memory modes with 1, 2, 4 ... maxThreads threads
+    void run(int maxThreads);
+
+private:
+    class Result {
+    public:
+        double seconds = 0;
+        i64 missingCnt = 0;
+        /// nanoseconds of probes of each table
+        std::vector<std::vector<u32>> latencyVec;
+    };
+
+    void    runPass(EgtbDb& egtbDb, int threadCnt, Result& result) const;
+    void    printResult(const std::string& title, const Result& result) const;
+
+    std::string folder;
+    std::vector<EgtbBoard> boards;
+    /// indexes of tableNames of boards
+    std::vector<int> tableIdxs;
+    std::vector<std::string> tableNames;
+};
+
+} // namespace fegtb
+
+#endif /* fegtb_bench_h */
@@ -0,0 +1,526 @@
+/**
+ This file is part of Felicity Egtb, distributed under MIT license.
+
+ * Copyright (c) 2024 Nguyen Hong Pham (github@nguyenpham)
+ * Copyright (c) 2024 developers
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ */
+
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#include "egtb.h"
+#include "egtbcache.h"
+
+using namespace fegtb;
+
+EgtbBlockCache fegtb::egtbBlockCache;
+EgtbFileHandleCache fegtb::egtbFileHandleCache;
+EgtbSharedBlockCache fegtb::egtbSharedBlockCache;
+
+static_assert((EgtbBlockCache::ThreadCacheSize & (EgtbBlockCache::ThreadCacheSize - 1)) == 0, "ThreadCacheSize must be a power of two");
+static_assert((EgtbBlockCache::ShardCount & (EgtbBlockCache::ShardCount - 1)) == 0 && EgtbBlockCache::ShardCount <= 16, "shard index is taken from the top 4 bits of a hash");
+
+EgtbBlockCache::EgtbBlockCache()
+{
+    maxSize = DefaultMaxSize;
+    generation = 0;
+}
+
+EgtbBlockCache::ThreadItem& EgtbBlockCache::getThreadItem(u64 key)
+{
+    static thread_local ThreadItem threadItems[ThreadCacheSize];
+    return threadItems[(key ^ (key >> 41)) & (ThreadCacheSize - 1)];
+}
+
+EgtbBlockPtr EgtbBlockCache::find(u64 key)
+{
+    auto gen = generation.load(std::memory_order_acquire);
+    auto& item = getThreadItem(key);
+    if (item.key == key && item.owner == this && item.generation == gen) {
+        return item.block;
+    }
+
+    EgtbBlockPtr block;
+    {
+        auto& shard = getShard(key);
+        std::lock_guard<std::mutex> thelock(shard.mtx);
+
+        auto it = shard.keyMap.find(key);
+        if (it == shard.keyMap.end()) {
+            return nullptr;
+        }
+
+        /// move to the front, the most recent one
+        shard.lruList.splice(shard.lruList.begin(), shard.lruList, it->second);
+        block = it->second->second;
+    }
+
+    item.owner = this; item.generation = gen; item.key = key; item.block = block;
+    return block;
+}
+
+EgtbBlockPtr EgtbBlockCache::add(u64 key, EgtbBlockPtr block)
+{
+    assert(block);
+    auto gen = generation.load(std::memory_order_acquire);
+    {
+        auto& shard = getShard(key);
+        std::lock_guard<std::mutex> thelock(shard.mtx);
+
+        auto it = shard.keyMap.find(key);
+        if (it != shard.keyMap.end()) {
+            shard.lruList.splice(shard.lruList.begin(), shard.lruList, it->second);
+            block = it->second->second;
+        } else {
+            shard.lruList.emplace_front(key, block);
+            shard.keyMap[key] = shard.lruList.begin();
+            shard.size += chargeSize(*block);
+            evict(shard);
+        }
+    }
+
+    auto& item = getThreadItem(key);
+    item.owner = this; item.generation = gen; item.key = key; item.block = block;
+    return block;
+}
+
+/// Callers may still hold evicted blocks, they are freed when released
+void EgtbBlockCache::evict(Shard& shard)
+{
+    auto shardMaxSize = maxSize / ShardCount;
+    while (shard.size > shardMaxSize && !shard.lruList.empty()) {
+        auto& item = shard.lruList.back();
+        shard.size -= chargeSize(*item.second);
+        shard.keyMap.erase(item.first);
+        shard.lruList.pop_back();
+    }
+}
+
+void EgtbBlockCache::removeFile(u32 fileId)
+{
+    generation++;
+    for (auto && shard : shards) {
+        std::lock_guard<std::mutex> thelock(shard.mtx);
+        for (auto it = shard.lruList.begin(); it != shard.lruList.end();) {
+            if (getFileId(it->first) == fileId) {
+                shard.size -= chargeSize(*it->second);
+                shard.keyMap.erase(it->first);
+                it = shard.lruList.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+void EgtbBlockCache::clear()
+{
+    generation++;
+    for (auto && shard : shards) {
+        std::lock_guard<std::mutex> thelock(shard.mtx);
+        shard.lruList.clear();
+        shard.keyMap.clear();
+        shard.size = 0;
+    }
+}
+
+void EgtbBlockCache::setMaxSize(i64 sz)
+{
+    maxSize = std::max<i64>(0, sz);
+    for (auto && shard : shards) {
+        std::lock_guard<std::mutex> thelock(shard.mtx);
+        evict(shard);
+    }
+}
+
+i64 EgtbBlockCache::getSize() const
+{
+    i64 sz = 0;
+    for (auto && shard : shards) {
+        std::lock_guard<std::mutex> thelock(shard.mtx);
+        sz += shard.size;
+    }
+    return sz;
+}
+
+//////////////////////////////////////////////////////////////////////
+static_assert(std::atomic<u64>::is_always_lock_free && std::atomic<u32>::is_always_lock_free, "atomics in shared memory must be lock-free");
+
+EgtbSharedBlockCache::~EgtbSharedBlockCache()
+{
+    close();
+}
+
+bool EgtbSharedBlockCache::open(const std::string& name, i64 sz, int maxBlockSize)
+{
+    close();
+
+#ifdef _WIN32
+    std::cerr << "Error: shared block caches are not supported on this platform" << std::endl;
+    return false;
+#else
+    /// only the process creating the object sets its size, others map the size it has
+    auto created = true;
+    auto fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+    if (fd < 0 && errno == EEXIST) {
+        created = false;
+        fd = shm_open(name.c_str(), O_RDWR, 0666);
+    }
+    if (fd < 0) {
+        std::cerr << "Error: cannot open shared memory " << name << ", " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    if (created) {
+        auto minSz = headerSize + WayCount * (i64)(sizeof(Slot) + maxBlockSize);
+        if (ftruncate(fd, std::max(sz, minSz)) != 0) {
+            std::cerr << "Error: cannot set size of shared memory " << name << ", " << strerror(errno) << std::endl;
+            ::close(fd);
+            shm_unlink(name.c_str());
+            return false;
+        }
+    } else {
+        /// the creator may not have set the size yet
+        for (auto i = 0; i < 1000 && fstat(fd, &st) == 0 && st.st_size == 0; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    if (fstat(fd, &st) != 0 || st.st_size <= headerSize) {
+        std::cerr << "Error: invalid size of shared memory " << name << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    auto p = ::mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        std::cerr << "Error: cannot map shared memory " << name << ", " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    header = (Header*)p;
+    mapSize = st.st_size;
+
+    /// new memory is zeroed. The creator sets up the header, others wait for it
+    if (created) {
+        header->maxBlockSize = (u32)maxBlockSize;
+        auto sSize = ((i64)sizeof(Slot) + maxBlockSize + 63) & ~63LL;
+        header->slotCount = (u64)((mapSize - headerSize) / sSize / WayCount * WayCount);
+        header->state.store(Magic, std::memory_order_release);
+    } else {
+        for (auto i = 0; i < 1000 && header->state.load(std::memory_order_acquire) != Magic; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    /// the geometry of the creator is adopted, but it must fit the mapped size
+    if (header->state.load(std::memory_order_acquire) != Magic || header->slotCount == 0 || header->slotCount % WayCount != 0
+        || header->maxBlockSize == 0 || header->maxBlockSize > (u32)(mapSize - headerSize)
+        || headerSize + header->slotCount * (u64)((sizeof(Slot) + header->maxBlockSize + 63) & ~63ULL) > (u64)mapSize) {
+        std::cerr << "Error: invalid shared memory " << name << std::endl;
+        close();
+        return false;
+    }
+
+    slotSize = ((i64)sizeof(Slot) + header->maxBlockSize + 63) & ~63LL;
+    return true;
+#endif
+}
+
+void EgtbSharedBlockCache::close()
+{
+#ifndef _WIN32
+    if (header) {
+        munmap(header, mapSize);
+    }
+#endif
+    header = nullptr;
+    mapSize = slotSize = 0;
+}
+
+bool EgtbSharedBlockCache::unlink(const std::string& name)
+{
+#ifdef _WIN32
+    return false;
+#else
+    return shm_unlink(name.c_str()) == 0;
+#endif
+}
+
+u64 EgtbSharedBlockCache::getSetIdx(u64 tableId, i64 blockIdx) const
+{
+    auto h = (tableId ^ (u64(blockIdx) * 0x9E3779B97F4A7C15ULL)) * 0xC2B2AE3D27D4EB4FULL;
+    h ^= h >> 31;
+    return h % (header->slotCount / WayCount) * WayCount;
+}
+
+EgtbBlockPtr EgtbSharedBlockCache::find(u64 tableId, i64 blockIdx)
+{
+    if (!header) {
+        return nullptr;
+    }
+
+    auto setIdx = getSetIdx(tableId, blockIdx);
+    for (auto w = 0; w < WayCount; w++) {
+        auto slot = getSlot(setIdx + w);
+        auto seq = slot->seq.load(std::memory_order_acquire);
+        if ((seq & 1) || seq == 0 || slot->tableId != tableId || slot->blockIdx != blockIdx) {
+            continue;
+        }
+
+        auto size = slot->size;
+        if (size <= 0 || size > (int)header->maxBlockSize) {
+            continue;
+        }
+        auto block = std::make_shared<EgtbBlock>(size);
+        memcpy(block->data, (char*)slot + sizeof(Slot), size);
+        block->startIdx = slot->startIdx;
+        block->endIdx = slot->endIdx;
+        block->encoded = slot->encoded != 0;
+
+        /// written while copying
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->seq.load(std::memory_order_relaxed) != seq
+            || slot->tableId != tableId || slot->blockIdx != blockIdx) {
+            continue;
+        }
+
+        slot->lastUse.store(header->clock.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+        header->hits.fetch_add(1, std::memory_order_relaxed);
+        return block;
+    }
+
+    header->misses.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+}
+
+void EgtbSharedBlockCache::add(u64 tableId, i64 blockIdx, const EgtbBlock& block)
+{
+    if (!header || block.size <= 0 || block.size > (int)header->maxBlockSize) {
+        return;
+    }
+
+    /// the least recently used slot of the set, or the one having the key already
+    auto setIdx = getSetIdx(tableId, blockIdx);
+    Slot* victim = nullptr;
+    u64 victimSeq = 0;
+    for (auto w = 0; w < WayCount; w++) {
+        auto slot = getSlot(setIdx + w);
+        auto seq = slot->seq.load(std::memory_order_acquire);
+        if (seq & 1) {
+            continue; /// being written
+        }
+        if (seq != 0 && slot->tableId == tableId && slot->blockIdx == blockIdx) {
+            return;
+        }
+        if (!victim || seq == 0 || slot->lastUse.load(std::memory_order_relaxed) < victim->lastUse.load(std::memory_order_relaxed)) {
+            victim = slot;
+            victimSeq = seq;
+            if (seq == 0) {
+                break;
+            }
+        }
+    }
+
+    /// another writer took it, the block is simply not shared
+    if (!victim || !victim->seq.compare_exchange_strong(victimSeq, victimSeq + 1, std::memory_order_acq_rel)) {
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+
+    victim->tableId = tableId;
+    victim->blockIdx = blockIdx;
+    victim->startIdx = block.startIdx;
+    victim->endIdx = block.endIdx;
+    victim->size = block.size;
+    victim->encoded = block.encoded;
+    memcpy((char*)victim + sizeof(Slot), block.data, block.size);
+    victim->lastUse.store(header->clock.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+
+    victim->seq.store(victimSeq + 2, std::memory_order_release);
+}
+
+u64 EgtbSharedBlockCache::getHits() const
+{
+    return header ? header->hits.load(std::memory_order_relaxed) : 0;
+}
+
+u64 EgtbSharedBlockCache::getMisses() const
+{
+    return header ? header->misses.load(std::memory_order_relaxed) : 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+EgtbFileHandleCache::Handle::~Handle()
+{
+    closeFileForRead(handle);
+}
+
+EgtbFileHandleCache::HandlePtr EgtbFileHandleCache::get(const std::string& path)
+{
+    {
+        std::lock_guard<std::mutex> thelock(mtx);
+        auto it = pathMap.find(path);
+        if (it != pathMap.end()) {
+            lruList.splice(lruList.begin(), lruList, it->second);
+            return it->second->second;
+        }
+    }
+
+    /// open it without holding the lock, another thread may do the same, only one is kept
+    auto handle = openFileForRead(path);
+    if (!handle) {
+        return nullptr;
+    }
+    auto ptr = std::make_shared<Handle>(handle);
+
+    std::lock_guard<std::mutex> thelock(mtx);
+    auto it = pathMap.find(path);
+    if (it != pathMap.end()) {
+        lruList.splice(lruList.begin(), lruList, it->second);
+        return it->second->second;
+    }
+
+    lruList.emplace_front(path, ptr);
+    pathMap[path] = lruList.begin();
+    evict();
+    return ptr;
+}
+
+/// Files being read by other threads are closed after their reads complete
+void EgtbFileHandleCache::evict()
+{
+    while ((int)lruList.size() > std::max(1, maxOpen)) {
+        pathMap.erase(lruList.back().first);
+        lruList.pop_back();
+    }
+}
+
+bool EgtbFileHandleCache::read(const std::string& path, i64 offset, char* buf, i64 sz)
+{
+    auto ptr = get(path);
+    return ptr && readFileAt(ptr->handle, offset, buf, sz);
+}
+
+void EgtbFileHandleCache::close(const std::string& path)
+{
+    std::lock_guard<std::mutex> thelock(mtx);
+    auto it = pathMap.find(path);
+    if (it != pathMap.end()) {
+        lruList.erase(it->second);
+        pathMap.erase(it);
+    }
+}
+
+void EgtbFileHandleCache::closeAll()
+{
+    std::lock_guard<std::mutex> thelock(mtx);
+    lruList.clear();
+    pathMap.clear();
+}
+
+void EgtbFileHandleCache::setMaxOpen(int n)
+{
+    std::lock_guard<std::mutex> thelock(mtx);
+    maxOpen = n;
+    evict();
+}
+
+int EgtbFileHandleCache::getOpenCount() const
+{
+    std::lock_guard<std::mutex> thelock(mtx);
+    return (int)lruList.size();
+}
+
+//////////////////////////////////////////////////////////////////////
+void EgtbMemBudget::setMaxSize(i64 sz)
+{
+    maxSize = std::max<i64>(0, sz);
+    shrink();
+}
+
+i64 EgtbMemBudget::getSize() const
+{
+    std::lock_guard<std::mutex> thelock(mtx);
+    return size;
+}
+
+void EgtbMemBudget::charge(EgtbFile* egtbFile, i64 sz)
+{
+    {
+        std::lock_guard<std::mutex> thelock(mtx);
+        auto& oldSz = chargeMap[egtbFile];
+        size += sz - oldSz;
+        oldSz = sz;
+        if (sz == 0) {
+            chargeMap.erase(egtbFile);
+        }
+    }
+    shrink(egtbFile);
+}
+
+void EgtbMemBudget::remove(EgtbFile* egtbFile)
+{
+    std::lock_guard<std::mutex> thelock(mtx);
+    auto it = chargeMap.find(egtbFile);
+    if (it != chargeMap.end()) {
+        size -= it->second;
+        chargeMap.erase(it);
+    }
+}
+
+void EgtbMemBudget::shrink(const EgtbFile* exceptFile)
+{
+    auto maxSz = maxSize.load();
+
+    /// files are evicted under the lock, thus they can't be removed nor destroyed meanwhile
+    std::lock_guard<std::mutex> thelock(mtx);
+    if (maxSz <= 0 || size <= maxSz) {
+        return;
+    }
+
+    std::vector<std::pair<u64, EgtbFile*>> candidateVec;
+    for (auto && p : chargeMap) {
+        if (p.first != exceptFile) {
+            candidateVec.push_back(std::make_pair(p.first->getLastAccess(), p.first));
+        }
+    }
+
+    /// the oldest first. Busy files are skipped, they will be tried again next time
+    std::sort(candidateVec.begin(), candidateVec.end());
+    for (auto && p : candidateVec) {
+        if (size <= maxSz) {
+            break;
+        }
+        if (p.second->evict()) {
+            auto it = chargeMap.find(p.second);
+            if (it != chargeMap.end()) {
+                size -= it->second;
+                chargeMap.erase(it);
+            }
+        }
+    }
+}
@@ -0,0 +1,280 @@
+/**
+ This file is part of Felicity Egtb, distributed under MIT license.
+
+ * Copyright (c) 2024 Nguyen Hong Pham (github@nguyenpham)
+ * Copyright (c) 2024 developers
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ */
+
+#ifndef fegtb_cache_h
+#define fegtb_cache_h
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "egtb.h"
+
+namespace fegtb {
+
+class EgtbFile;
+
+/*
+ * A decompressed block of data, it is not changed after being added to the cache.
+ * Blocks of the grammar codec may be kept encoded, their items are decoded when reading
+ */
+class EgtbBlock {
+public:
+    EgtbBlock(int bufSize) {
+        data = (char*)malloc(bufSize + 16);
+        size = bufSize;
+    }
+
+    ~EgtbBlock() {
+        free(data);
+    }
+
+    char*   data;
+    int     size;
+    bool    encoded = false;
+
+    /// range of indexes (items, not bytes) stored in this block
+    i64     startIdx = 0, endIdx = 0;
+};
+
+typedef std::shared_ptr<const EgtbBlock> EgtbBlockPtr;
+
+
+/*
+ * LRU cache of decompressed blocks, shared by all EgtbFiles. Keys are split into
+ * shards, each has its own lock and a part of the total memory budget.
+ * Each thread also keeps a few recent blocks of its own, hits on them don't lock at all
+ */
+class EgtbBlockCache {
+public:
+    static const int ShardCount = 16;
+    static const i64 DefaultMaxSize = 32 * 1024 * 1024L;
+    static const int ThreadCacheSize = 32;
+
+    EgtbBlockCache();
+
+    /// keys: block index in the low bits, then the side, the file id in all the rest
+    static const int BlockIdxBits = 32;
+    static const u32 MaxFileId = (1u << (63 - BlockIdxBits)) - 1;
+
+    static u64 createKey(u32 fileId, bslib::Side side, i64 blockIdx) {
+        assert(fileId <= MaxFileId && blockIdx >= 0 && blockIdx < (1LL << BlockIdxBits));
+        return (u64(fileId) << (BlockIdxBits + 1)) | (u64(static_cast<int>(side)) << BlockIdxBits) | u64(blockIdx);
+    }
+    static u32 getFileId(u64 key) {
+        return u32(key >> (BlockIdxBits + 1));
+    }
+
+    EgtbBlockPtr find(u64 key);
+
+    /// if the key is in the cache already, the old block is kept and returned
+    EgtbBlockPtr add(u64 key, EgtbBlockPtr block);
+
+    void removeFile(u32 fileId);
+    void clear();
+
+    /// memory budget in bytes for all shared blocks, 0 to disable the shared cache
+    void setMaxSize(i64 sz);
+    i64 getMaxSize() const { return maxSize; }
+    i64 getSize() const;
+
+private:
+    class Shard {
+    public:
+        mutable std::mutex mtx;
+        std::list<std::pair<u64, EgtbBlockPtr>> lruList;
+        std::unordered_map<u64, std::list<std::pair<u64, EgtbBlockPtr>>::iterator> keyMap;
+        i64 size = 0;
+    };
+
+    Shard& getShard(u64 key) {
+        /// blocks of a file are consecutive, mix bits to spread them to all shards
+        auto h = key * 0x9E3779B97F4A7C15ULL;
+        return shards[(h >> 60) & (ShardCount - 1)];
+    }
+
+    static i64 chargeSize(const EgtbBlock& block) {
+        return block.size + 64;
+    }
+
+    /// per-thread cache, entries from an older generation are ignored
+    class ThreadItem {
+    public:
+        const EgtbBlockCache* owner = nullptr;
+        u32 generation = 0;
+        u64 key = 0;
+        EgtbBlockPtr block;
+    };
+
+    static ThreadItem& getThreadItem(u64 key);
+
+    void evict(Shard& shard);
+
+    Shard shards[ShardCount];
+    std::atomic<i64> maxSize;
+    std::atomic<u32> generation;
+};
+
+extern EgtbBlockCache egtbBlockCache;
+
+
+/*
+ * Cache of decompressed blocks in POSIX shared memory, shared by processes on the same host,
+ * thus a block is decompressed once for all of them. Keys are ids of table files (from their
+ * names, sides, sizes and modified times, the same in all processes) and block indexes.
+ * Slots are grouped into sets of WayCount, the least recently used slot of a set is replaced.
+ * Each slot has a sequence number, odd while being written: readers copy data without locking
+ * then check the number again, writers take a slot by changing the number from even to odd
+ */
+class EgtbSharedBlockCache {
+public:
+    static const int WayCount = 4;
+    static const u32 Magic = 0x43534746; // "FGSC"
+    static const i64 DefaultSize = 256 * 1024 * 1024L;
+    /// the default size of compress blocks
+    static const int DefaultMaxBlockSize = 4 * 1024;
+
+    ~EgtbSharedBlockCache();
+
+    /// Open (create if needed) a shared memory object. The process creating it sets its size and
+    /// the max block size, others use them whatever they ask for. Blocks larger than maxBlockSize
+    /// are not shared
+    bool open(const std::string& name, i64 sz, int maxBlockSize = DefaultMaxBlockSize);
+    void close();
+    bool isOpen() const { return header != nullptr; }
+
+    /// remove the shared memory object, processes using it keep their mappings
+    static bool unlink(const std::string& name);
+
+    EgtbBlockPtr find(u64 tableId, i64 blockIdx);
+    void add(u64 tableId, i64 blockIdx, const EgtbBlock& block);
+
+    i64 getSize() const { return mapSize; }
+    u64 getHits() const;
+    u64 getMisses() const;
+
+private:
+    class Header {
+    public:
+        std::atomic<u32> state;
+        u32 maxBlockSize;
+        u64 slotCount;
+        std::atomic<u64> clock, hits, misses;
+    };
+
+    class Slot {
+    public:
+        std::atomic<u64> seq;
+        std::atomic<u64> lastUse;
+        u64 tableId;
+        i64 blockIdx, startIdx, endIdx;
+        i32 size, encoded;
+    };
+
+    Slot* getSlot(u64 idx) const {
+        return (Slot*)((char*)header + headerSize + idx * slotSize);
+    }
+    u64 getSetIdx(u64 tableId, i64 blockIdx) const;
+
+    static const int headerSize = 64;
+
+    Header* header = nullptr;
+    i64 mapSize = 0;
+    i64 slotSize = 0;
+};
+
+extern EgtbSharedBlockCache egtbSharedBlockCache;
+
+
+/*
+ * Open files for reading blocks, kept open between probes. When there are too many,
+ * the least recently used ones are closed. Reads are positional, they don't share
+ * a file pointer thus many threads can read the same file at the same time
+ */
+class EgtbFileHandleCache {
+public:
+    static const int DefaultMaxOpen = 256;
+
+    /// read exactly sz bytes from the given offset of the file
+    bool read(const std::string& path, i64 offset, char* buf, i64 sz);
+
+    void close(const std::string& path);
+    void closeAll();
+
+    void setMaxOpen(int n);
+    int getMaxOpen() const { return maxOpen; }
+    int getOpenCount() const;
+
+private:
+    /// closes the file when the last user releases it
+    class Handle {
+    public:
+        Handle(void* handle) : handle(handle) {}
+        ~Handle();
+        void* handle;
+    };
+    typedef std::shared_ptr<Handle> HandlePtr;
+
+    HandlePtr get(const std::string& path);
+    void evict();
+
+    mutable std::mutex mtx;
+    std::list<std::pair<std::string, HandlePtr>> lruList;
+    std::unordered_map<std::string, std::list<std::pair<std::string, HandlePtr>>::iterator> pathMap;
+    int maxOpen = DefaultMaxOpen;
+};
+
+extern EgtbFileHandleCache egtbFileHandleCache;
+
+
+/*
+ * RAM budget of a database. Files report memory of their data buffers and compress tables,
+ * when the total is over the budget, the least recently used files are evicted back
+ * to header-only state. Files being probed are pinned and never evicted
+ */
+class EgtbMemBudget {
+public:
+    /// budget in bytes, 0 for no limit
+    void setMaxSize(i64 sz);
+    i64 getMaxSize() const { return maxSize; }
+    i64 getSize() const;
+
+    /// set the memory used by the file, then evict others if the budget is exceeded
+    void charge(EgtbFile* egtbFile, i64 sz);
+    void remove(EgtbFile* egtbFile);
+
+    /// evict least recently used files (except the given one) until the total fits the budget
+    void shrink(const EgtbFile* exceptFile = nullptr);
+
+    u64 tick() {
+        return clock.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+private:
+    mutable std::mutex mtx;
+    std::unordered_map<EgtbFile*, i64> chargeMap;
+    i64 size = 0;
+    std::atomic<i64> maxSize { 0 };
+    std::atomic<u64> clock { 0 };
+};
+
+} // namespace fegtb
+
+#endif
@@ -0,0 +1,207 @@
+/**
+ This file is part of Felicity Egtb, distributed under MIT license.
+
+ * Copyright (c) 2024 Nguyen Hong Pham (github@nguyenpham)
+ * Copyright (c) 2024 developers
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ */
+
+
+#include <mutex>
+#include <string.h>
+
+#include "egtbcapi.h"
+#include "egtbdb.h"
+#include "egtbkey.h"
+
+#include "../base/funcs.h"
+
+using namespace fegtb;
+using namespace bslib;
+
+static_assert(FEGTB_SCORE_MATE == EGTB_SCORE_MATE && FEGTB_SCORE_MISSING == EGTB_SCORE_MISSING
+              && FEGTB_SCORE_ILLEGAL == EGTB_SCORE_ILLEGAL && FEGTB_SCORE_UNKNOWN == EGTB_SCORE_UNKNOWN, "scores of the C API");
+static_assert(FEGTB_WDL_WIN == EGTB_WDL_WIN && FEGTB_WDL_LOSS == EGTB_WDL_LOSS, "WDL of the C API");
+static_assert(FEGTB_MEM_TINY == EgtbMemMode::tiny && FEGTB_MEM_ALL == EgtbMemMode::all
+              && FEGTB_MEM_SMART == EgtbMemMode::smart && FEGTB_MEM_MMAP == EgtbMemMode::mmap, "memory modes of the C API");
+
+struct fegtb_db {
+    EgtbDb egtbDb;
+};
+
+/// boards are reused by threads, setting up one doesn't allocate memory
+static EgtbBoard* setupBoard(const fegtb_piece* pieces, int pieceCount, int sideToMove)
+{
+    static thread_local EgtbBoard board;
+
+    if (!pieces || pieceCount < 2 || pieceCount > 32 || (sideToMove != 0 && sideToMove != 1)) {
+        return nullptr;
+    }
+
+    board.reset();
+    for (auto i = 0; i < pieceCount; i++) {
+        auto& p = pieces[i];
+        if (p.type <= 0 || p.type > PAWN || (p.side != 0 && p.side != 1)
+            || p.square < 0 || p.square >= BOARD_SZ || !board.isEmpty(p.square)) {
+            return nullptr;
+        }
+        board.setPiece(p.square, Piece(static_cast<PieceType>(p.type), static_cast<Side>(p.side)));
+    }
+    board.side = static_cast<Side>(sideToMove);
+    return board.isValid() ? &board : nullptr;
+}
+
+int fegtb_api_version(void)
+{
+    return FEGTB_API_VERSION;
+}
+
+const char* fegtb_variant(void)
+{
+#ifdef _FELICITY_CHESS_
+    return "chess";
+#else
+    return "xiangqi";
+#endif
+}
+
+/// No exception may cross the C boundary, entry points which can throw (mostly std::bad_alloc)
+/// catch all and return their failure values
+fegtb_db* fegtb_open(const char* folders, int memMode, int64_t cacheSize)
+{
+    fegtb_db* db = nullptr;
+    try {
+        static std::once_flag initFlag;
+        std::call_once(initFlag, [] { EgtbKey::initOnce(); });
+
+        if (!folders || memMode < FEGTB_MEM_TINY || memMode > FEGTB_MEM_MMAP) {
+            return nullptr;
+        }
+
+        db = new fegtb_db;
+        if (cacheSize > 0) {
+            db->egtbDb.setCacheSize(cacheSize);
+        }
+
+        for (auto && folder : Funcs::splitString(folders, ';')) {
+            auto s = Funcs::trim(folder);
+            if (!s.empty()) {
+                db->egtbDb.addFolders(s);
+            }
+        }
+        db->egtbDb.preload(static_cast<EgtbMemMode>(memMode));
+
+        if (db->egtbDb.getSize() == 0) {
+            delete db;
+            return nullptr;
+        }
+        return db;
+    } catch (...) {
+        delete db;
+        return nullptr;
+    }
+}
+
+void fegtb_close(fegtb_db* db)
+{
+    try {
+        delete db;
+    } catch (...) {
+    }
+}
+
+int fegtb_table_count(const fegtb_db* db)
+{
+    return db ? db->egtbDb.getSize() : 0;
+}
+
+int fegtb_probe(fegtb_db* db, const fegtb_piece* pieces, int pieceCount, int sideToMove)
+{
+    try {
+        auto board = db ? setupBoard(pieces, pieceCount, sideToMove) : nullptr;
+        if (!board) {
+            return FEGTB_SCORE_MISSING;
+        }
+
+        /// as getScore but quiet for missing tables
+        int score;
+        db->egtbDb.getScores(board, 1, &score);
+        return score;
+    } catch (...) {
+        return FEGTB_SCORE_MISSING;
+    }
+}
+
+int fegtb_probe_wdl(fegtb_db* db, const fegtb_piece* pieces, int pieceCount, int sideToMove)
+{
+    try {
+        auto board = db ? setupBoard(pieces, pieceCount, sideToMove) : nullptr;
+        return board ? db->egtbDb.getWDL(*board) : FEGTB_SCORE_MISSING;
+    } catch (...) {
+        return FEGTB_SCORE_MISSING;
+    }
+}
+
+int fegtb_probe_root(fegtb_db* db, const fegtb_piece* pieces, int pieceCount, int sideToMove,
+                     fegtb_move_score* moves, int maxMoves, int* moveCount)
+{
+    if (moveCount) {
+        *moveCount = 0;
+    }
+
+    try {
+        auto board = db ? setupBoard(pieces, pieceCount, sideToMove) : nullptr;
+        if (!board) {
+            return FEGTB_SCORE_MISSING;
+        }
+
+        std::vector<EgtbMoveScore> moveScores;
+        auto score = db->egtbDb.getMoveScores(*board, moveScores);
+
+        for (auto i = 0; i < (int)moveScores.size() && i < maxMoves && moves; i++) {
+            auto& m = moveScores[i];
+            moves[i].from = m.move.from;
+            moves[i].dest = m.move.dest;
+            moves[i].promotion = static_cast<int>(m.move.promotion);
+            moves[i].score = m.score;
+        }
+        if (moveCount) {
+            *moveCount = (int)moveScores.size();
+        }
+        return score;
+    } catch (...) {
+        return FEGTB_SCORE_MISSING;
+    }
+}
+
+void fegtb_set_stats(int enabled)
+{
+    egtbStats = enabled != 0;
+}
+
+int fegtb_stats_json(const fegtb_db* db, char* buf, int bufSize)
+{
+    if (!db) {
+        return 0;
+    }
+
+    try {
+        auto str = db->egtbDb.getStatsJson();
+        auto len = (int)str.size();
+        if (buf && bufSize > len) {
+            memcpy(buf, str.c_str(), len + 1);
+        }
+        return len;
+    } catch (...) {
+        return 0;
+    }
+}
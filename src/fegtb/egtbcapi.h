@@ -0,0 +1,116 @@
+/**
+ This file is part of Felicity Egtb, distributed under MIT license.
+
+ * Copyright (c) 2024 Nguyen Hong Pham (github@nguyenpham)
+ * Copyright (c) 2024 developers
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ */
+
+
+#ifndef fegtb_capi_h
+#define fegtb_capi_h
+
+/*
+ * C API of the probe library, for the shared library (libfegtb) built by build.sh / buildxq.sh.
+ * It needs no C++ classes nor defines of the variant, boards are lists of pieces.
+ * All functions are thread-safe, a database may be probed by many threads at the same time.
+ * No C++ exception leaves them, failures (such as out of memory) give their error values.
+ *
+ * Squares are indexes of the library, row by row from the top (black side):
+ *   chess:   0 = a8, 7 = h8, 63 = h1
+ *   xiangqi: 0 = a9, 8 = i9, 89 = i0
+ * Piece types:
+ *   chess:   1 king, 2 queen, 3 rook, 4 bishop, 5 knight, 6 pawn
+ *   xiangqi: 1 king, 2 advisor, 3 elephant, 4 rook, 5 cannon, 6 horse, 7 pawn
+ * Sides: 0 black, 1 white (red in xiangqi). Castling rights and en passant are not probed
+ */
+
+#include <stdint.h>
+
+#if defined(_WIN32) && defined(FEGTB_DLL_IMPORT)
+#define FEGTB_API __declspec(dllimport)
+#elif defined(_WIN32)
+#define FEGTB_API __declspec(dllexport)
+#else
+#define FEGTB_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FEGTB_API_VERSION       1
+
+/// memory modes, see EgtbMemMode
+#define FEGTB_MEM_TINY          0
+#define FEGTB_MEM_ALL           1
+#define FEGTB_MEM_SMART         2
+#define FEGTB_MEM_MMAP          3
+
+/// scores are distances to mate: FEGTB_SCORE_MATE - plies for wins, negative for losses
+#define FEGTB_SCORE_DRAW        0
+#define FEGTB_SCORE_MATE        1000
+#define FEGTB_SCORE_ILLEGAL     1004
+#define FEGTB_SCORE_UNKNOWN     1005
+#define FEGTB_SCORE_MISSING     1006
+
+#define FEGTB_WDL_LOSS          (-1)
+#define FEGTB_WDL_DRAW          0
+#define FEGTB_WDL_WIN           1
+
+typedef struct fegtb_db fegtb_db;
+
+typedef struct fegtb_piece {
+    int type, side, square;
+} fegtb_piece;
+
+/// promotion is a piece type or 0
+typedef struct fegtb_move_score {
+    int from, dest, promotion, score;
+} fegtb_move_score;
+
+FEGTB_API int fegtb_api_version(void);
+/// "chess" or "xiangqi"
+FEGTB_API const char* fegtb_variant(void);
+
+/// Open tables of folders (separated by ';'), cacheSize is the budget (bytes) of the block cache,
+/// 0 for the default. Return NULL if no table is found
+FEGTB_API fegtb_db* fegtb_open(const char* folders, int memMode, int64_t cacheSize);
+FEGTB_API void fegtb_close(fegtb_db* db);
+
+/// number of tables
+FEGTB_API int fegtb_table_count(const fegtb_db* db);
+
+/// DTM score of the position for the side to move, FEGTB_SCORE_MISSING if it can't be probed
+FEGTB_API int fegtb_probe(fegtb_db* db, const fegtb_piece* pieces, int pieceCount, int sideToMove);
+
+/// FEGTB_WDL_WIN, FEGTB_WDL_DRAW, FEGTB_WDL_LOSS or FEGTB_SCORE_MISSING. WDL tables are used if available
+FEGTB_API int fegtb_probe_wdl(fegtb_db* db, const fegtb_piece* pieces, int pieceCount, int sideToMove);
+
+/// Scores of all legal moves (from the view of the side to move), best ones first. Up to
+/// maxMoves are written, moveCount gets the number of legal moves. Return the score of the
+/// position or FEGTB_SCORE_MISSING
+FEGTB_API int fegtb_probe_root(fegtb_db* db, const fegtb_piece* pieces, int pieceCount, int sideToMove,
+                               fegtb_move_score* moves, int maxMoves, int* moveCount);
+
+/// Counters of probing, collected after fegtb_set_stats(1). The switch is global to the process:
+/// it turns counting on or off for all databases, including ones used by other libraries or threads
+/// of the same process. The JSON string (with its ending 0) is written if bufSize is large enough,
+/// return its length
+FEGTB_API void fegtb_set_stats(int enabled);
+FEGTB_API int fegtb_stats_json(const fegtb_db* db, char* buf, int bufSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* fegtb_capi_h */
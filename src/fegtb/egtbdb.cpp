@@ -15,6 +15,10 @@
  copies or substantial portions of the Software.
  */
 
+#include <sstream>
+#include <fstream>
+#include <set>
+
 #include "egtb.h"
 #include "egtbdb.h"
 #include "egtbkey.h"
@@ -23,9 +27,7 @@
 using namespace fegtb;
 using namespace bslib;
 
-extern const int egtbOrderPieceValue[8];
-
-EgtbDb::EgtbDb() {
+EgtbDb::EgtbDb() : prefetchPool(2), probePool(3) {
 }
 
 EgtbDb::~EgtbDb() {
@@ -33,18 +35,117 @@ EgtbDb::~EgtbDb() {
 }
 
 void EgtbDb::closeAll() {
+    prefetchPool.wait();
     for (auto && egtbFile : egtbFileVec) {
         delete egtbFile;
     }
+    for (auto && egtbFile : wdlFileVec) {
+        delete egtbFile;
+    }
     folders.clear();
     egtbFileVec.clear();
     nameMap.clear();
+    signMap.clear();
+    wdlFileVec.clear();
+    wdlNameMap.clear();
+    wdlSignMap.clear();
 }
 
 void EgtbDb::removeAllProbedBuffers() {
+    prefetchPool.wait();
     for (auto && egtbFile : egtbFileVec) {
         egtbFile->removeBuffers();
     }
+    for (auto && egtbFile : wdlFileVec) {
+        egtbFile->removeBuffers();
+    }
+}
+
+void EgtbDb::setCacheSize(i64 sz) {
+    egtbBlockCache.setMaxSize(sz);
+}
+
+void EgtbDb::setMemoryBudget(i64 sz) {
+    prefetchPool.wait();
+    memBudget.setMaxSize(0);
+
+    auto budget = sz > 0 ? &memBudget : nullptr;
+    for (auto && fileVec : { &egtbFileVec, &wdlFileVec }) {
+        for (auto && pEgtbFile : *fileVec) {
+            pEgtbFile->setMemBudget(budget);
+        }
+    }
+    memBudget.setMaxSize(sz);
+}
+
+bool EgtbDb::openSharedCache(const std::string& name, i64 sz) {
+    return egtbSharedBlockCache.open(name, sz);
+}
+
+void EgtbDb::setMaxOpenFiles(int n) {
+    egtbFileHandleCache.setMaxOpen(n);
+}
+
+void EgtbDb::setPrefetchThreads(int n) {
+    prefetchPool.setThreadCount(n);
+}
+
+void EgtbDb::setPreloadThreads(int n) {
+    preloadThreadCnt = std::max(0, n);
+}
+
+void EgtbDb::setProbeThreads(int n) {
+    probePool.setThreadCount(n);
+}
+
+void EgtbDb::resetStats()
+{
+    for (auto && fileVec : { &egtbFileVec, &wdlFileVec }) {
+        for (auto && pEgtbFile : *fileVec) {
+            pEgtbFile->resetStats();
+        }
+    }
+}
+
+std::string EgtbDb::getStatsJson() const
+{
+    i64 totals[EgtbStats::itemCount] = {};
+    std::ostringstream tableStream;
+    auto tableCnt = 0;
+
+    for (auto && fileVec : { &egtbFileVec, &wdlFileVec }) {
+        for (auto && pEgtbFile : *fileVec) {
+            auto& stats = pEgtbFile->getStats();
+            if (stats.isEmpty()) {
+                continue;
+            }
+
+            for (auto i = 0; i < EgtbStats::itemCount; i++) {
+                auto item = static_cast<EgtbStats::Item>(i);
+                totals[i] += stats.get(Side::white, item) + stats.get(Side::black, item);
+            }
+
+            tableStream << (tableCnt++ ? "," : "")
+                        << "\"" << pEgtbFile->getName() << (pEgtbFile->isWDL() ? "_wdl" : "") << "\":"
+                        << stats.toJson();
+        }
+    }
+
+    std::ostringstream stringStream;
+    stringStream << "{\"enabled\":" << (egtbStats ? "true" : "false") << ",\"totals\":{";
+    for (auto i = 0; i < EgtbStats::itemCount; i++) {
+        stringStream << (i ? "," : "") << "\"" << EgtbStats::itemNames[i] << "\":" << totals[i];
+    }
+    stringStream << "},\"blockCache\":{\"size\":" << egtbBlockCache.getSize()
+                 << ",\"maxSize\":" << egtbBlockCache.getMaxSize() << "}"
+                 << ",\"sharedCache\":{\"size\":" << egtbSharedBlockCache.getSize()
+                 << ",\"hits\":" << egtbSharedBlockCache.getHits()
+                 << ",\"misses\":" << egtbSharedBlockCache.getMisses() << "}"
+                 << ",\"memory\":{\"size\":" << memBudget.getSize()
+                 << ",\"maxSize\":" << memBudget.getMaxSize() << "}"
+                 << ",\"openFiles\":" << egtbFileHandleCache.getOpenCount()
+                 << ",\"tables\":{" << tableStream.str() << "}}";
+    return stringStream.str();
 }
 
 void EgtbDb::setFolders(const std::vector<std::string>& folders_) {
@@ -67,25 +168,64 @@ void EgtbDb::preload(const std::string& folder, EgtbMemMode egtbMemMode, EgtbLoa
 
 void EgtbDb::preload(EgtbMemMode egtbMemMode, EgtbLoadMode loadMode)
 {
+    std::vector<std::string> pathVec;
     for (auto && folderName : folders) {
-        auto vec = listdir(folderName);
+        std::vector<std::string> vec;
+        if (!readManifest(folderName, vec)) {
+            vec = listdir(folderName);
+        }
 
         for (auto && path : vec) {
-            if (EgtbFile::getExtensionType(path) == EgtbType::dtm) {
-                auto egtbFile = new EgtbFile();
-                if (egtbFile->preload(path, egtbMemMode, loadMode)) {
-                    auto pos = nameMap.find(egtbFile->getName());
-                    if (pos == nameMap.end()) {
-                        addEgtbFile(egtbFile);
-                        continue;
-                    }
-                    pos->second->merge(*egtbFile);
+            auto egtbType = EgtbFile::getExtensionType(path);
+            if (egtbType == EgtbType::dtm || egtbType == EgtbType::wdl) {
+                pathVec.push_back(path);
+            }
+        }
+    }
+
+    /// each file is loaded into its own object, loadnow mode reads headers and tables
+    /// by many threads (many small reads)
+    auto cnt = (int)pathVec.size();
+    std::vector<EgtbFile*> loadingVec(cnt, nullptr);
+    std::vector<char> okVec(cnt, 0);
+
+    auto loadFunc = [&](int i) {
+        auto isWDL = EgtbFile::getExtensionType(pathVec[i]) == EgtbType::wdl;
+        auto egtbFile = new EgtbFile();
+        okVec[i] = egtbFile->preload(pathVec[i], isWDL ? wdlMemMode : egtbMemMode, loadMode);
+        loadingVec[i] = egtbFile;
+    };
+
+    if (loadMode == EgtbLoadMode::loadnow && preloadThreadCnt > 0 && cnt > 1) {
+        EgtbThreadPool loadPool(preloadThreadCnt);
+        loadPool.run(cnt, loadFunc);
+    } else {
+        for (auto i = 0; i < cnt; i++) {
+            loadFunc(i);
+        }
+    }
+
+    /// sides of the same endgame are merged in the order of paths, as loading one by one
+    for (auto i = 0; i < cnt; i++) {
+        auto egtbFile = loadingVec[i];
+        if (okVec[i]) {
+            auto isWDL = egtbFile->getEgtbType() == EgtbType::wdl;
+            auto& theNameMap = isWDL ? wdlNameMap : nameMap;
+
+            auto pos = theNameMap.find(egtbFile->getName());
+            if (pos == theNameMap.end()) {
+                if (isWDL) {
+                    addWDLFile(egtbFile);
                 } else {
-                    std::cout << "Error: not loaded: " << path << std::endl;
+                    addEgtbFile(egtbFile);
                 }
-                free(egtbFile);
+                continue;
             }
+            pos->second->merge(*egtbFile);
+        } else {
+            std::cout << "Error: not loaded: " << pathVec[i] << std::endl;
         }
+        delete egtbFile;
     }
 }
 
@@ -105,6 +245,9 @@ bool EgtbDb::verifyEgtbFileSides() const
 
 void EgtbDb::addEgtbFile(EgtbFile *egtbFile) {
     egtbFileVec.push_back(egtbFile);
+    if (memBudget.getMaxSize() > 0) {
+        egtbFile->setMemBudget(&memBudget);
+    }
 
     auto s = egtbFile->getName();
     nameMap[s] = egtbFile;
@@ -115,6 +258,63 @@ void EgtbDb::addEgtbFile(EgtbFile *egtbFile) {
     auto s1 = s.substr(p);
     s = s1 + s0;
     nameMap[s] = egtbFile;
+
+    auto sign = egtbFile->getMaterialsign();
+    signMap.add(sign, egtbFile);
+    signMap.add(EgtbFile::flipMaterialSign(sign), egtbFile);
+}
+
+void EgtbDb::addWDLFile(EgtbFile *egtbFile) {
+    wdlFileVec.push_back(egtbFile);
+    if (memBudget.getMaxSize() > 0) {
+        egtbFile->setMemBudget(&memBudget);
+    }
+    wdlNameMap[egtbFile->getName()] = egtbFile;
+
+    auto sign = egtbFile->getMaterialsign();
+    wdlSignMap.add(sign, egtbFile);
+    wdlSignMap.add(EgtbFile::flipMaterialSign(sign), egtbFile);
+}
+
+////////////////////////////////////////////////////////////////////////
+
+void EgtbSignMap::add(u64 sign, EgtbFile* egtbFile) {
+    if (sign == 0) {
+        return;
+    }
+
+    /// keep the load factor under 1/2
+    if ((cnt + 1) * 2 > (int)items.size()) {
+        std::vector<Item> oldItems;
+        oldItems.swap(items);
+        items.resize(std::max<size_t>(64, oldItems.size() * 2));
+        cnt = 0;
+        for (auto && item : oldItems) {
+            if (item.sign) {
+                add(item.sign, item.egtbFile);
+            }
+        }
+    }
+
+    auto mask = items.size() - 1;
+    for (auto k = hash(sign) & mask; ; k = (k + 1) & mask) {
+        auto& item = items[k];
+        if (item.sign == 0) {
+            item.sign = sign;
+            item.egtbFile = egtbFile;
+            cnt++;
+            return;
+        }
+        if (item.sign == sign) {
+            item.egtbFile = egtbFile;
+            return;
+        }
+    }
+}
+
+void EgtbSignMap::clear() {
+    items.clear();
+    cnt = 0;
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -134,6 +334,9 @@ int EgtbDb::getScore(EgtbBoard& board, Side side) {
 
 //    pEgtbFile->checkToLoadHeaderAndTables(side);
     pEgtbFile->checkToLoadHeaderAndTables(Side::none);
+    if (pEgtbFile->getLoadStatus() == EgtbLoadStatus::error) {
+        return EGTB_SCORE_MISSING;
+    }
     
     auto r = pEgtbFile->getKey(board);
     auto querySide = r.flipSide ? getXSide(side) : side;
@@ -157,6 +360,241 @@ int EgtbDb::getScore(EgtbBoard& board, Side side) {
     return EGTB_SCORE_MISSING;
 }
 
+void EgtbDb::getScores(const std::vector<EgtbBoard>& boards, std::vector<int>& scores, bool parallel) {
+    scores.resize(boards.size());
+    getScores(boards.data(), (int)boards.size(), scores.data(), parallel);
+}
+
+void EgtbDb::getScores(const EgtbBoard* boards, int cnt, int* scores, bool parallel) {
+    class ProbeRec {
+    public:
+        EgtbFile* egtbFile;
+        Side side;
+        i64 key;
+        int k;
+    };
+
+    std::vector<ProbeRec> vec;
+    vec.reserve(cnt);
+
+    for (auto k = 0; k < cnt; k++) {
+        scores[k] = EGTB_SCORE_MISSING;
+
+        auto& board = boards[k];
+        auto pEgtbFile = getEgtbFile(board);
+        if (pEgtbFile == nullptr) {
+            continue;
+        }
+        pEgtbFile->checkToLoadHeaderAndTables(Side::none);
+        if (pEgtbFile->getLoadStatus() == EgtbLoadStatus::error) {
+            continue;
+        }
+
+        auto r = pEgtbFile->getKey(board);
+        auto querySide = r.flipSide ? getXSide(board.side) : board.side;
+        if (pEgtbFile->getHeader()->isSide(querySide)) {
+            vec.push_back(ProbeRec{ pEgtbFile, querySide, r.key, k });
+        }
+    }
+
+    std::sort(vec.begin(), vec.end(), [](const ProbeRec& a, const ProbeRec& b) {
+        if (a.egtbFile != b.egtbFile) return a.egtbFile < b.egtbFile;
+        return a.side < b.side;
+    });
+
+    /// start of groups, the last item is the end
+    std::vector<size_t> groupVec;
+    for (size_t i = 0; i < vec.size(); i++) {
+        if (i == 0 || vec[i].egtbFile != vec[i - 1].egtbFile || vec[i].side != vec[i - 1].side) {
+            groupVec.push_back(i);
+        }
+    }
+    groupVec.push_back(vec.size());
+
+    auto probeGroup = [&](int g) {
+        auto from = groupVec[g], to = groupVec[g + 1];
+        std::vector<i64> idxVec;
+        std::vector<int> scoreVec;
+        for (auto t = from; t < to; t++) {
+            idxVec.push_back(vec[t].key);
+        }
+
+        vec[from].egtbFile->getScores(idxVec, vec[from].side, scoreVec);
+        for (auto t = from; t < to; t++) {
+            scores[vec[t].k] = scoreVec[t - from];
+        }
+    };
+
+    auto groupCnt = (int)groupVec.size() - 1;
+    if (parallel && groupCnt > 1) {
+        probePool.run(groupCnt, probeGroup);
+    } else {
+        for (auto g = 0; g < groupCnt; g++) {
+            probeGroup(g);
+        }
+    }
+}
+
+int EgtbDb::getMoveScores(EgtbBoard& board, std::vector<EgtbMoveScore>& moveScores, bool parallel) {
+    auto side = board.side;
+    auto xside = getXSide(side);
+
+    std::vector<EgtbBoard> children;
+    std::vector<bool> drawVec;
+    moveScores.clear();
+
+    for(auto && move : board.gen(side)) {
+        Hist hist;
+        board.make(move, hist);
+        board.side = xside;
+
+        if (!board.isIncheck(side)) {
+            moveScores.push_back(EgtbMoveScore{ move, EGTB_SCORE_MISSING });
+            children.push_back(board);
+            /// captured all attackers
+            drawVec.push_back(!hist.cap.isEmpty() && board.pieceList_isDraw());
+        }
+
+        board.takeBack(hist);
+        board.side = side;
+    }
+
+    if (moveScores.empty()) {
+        return board.isIncheck(side) ? -EGTB_SCORE_MATE : EGTB_SCORE_DRAW;
+    }
+
+    std::vector<int> scores;
+    getScores(children, scores, parallel);
+
+    /// from the view of the moving side, one ply more than children (as probe)
+    auto bestScore = -EGTB_SCORE_MATE;
+    auto missing = false;
+    for (size_t i = 0; i < moveScores.size(); i++) {
+        auto score = scores[i];
+        if (score == EGTB_SCORE_MISSING && drawVec[i]) {
+            score = EGTB_SCORE_DRAW;
+        }
+
+        if (score > EGTB_SCORE_MATE) {
+            missing = missing || score == EGTB_SCORE_MISSING;
+            moveScores[i].score = score;
+            continue;
+        }
+
+        score = -score;
+        if (score != EGTB_SCORE_DRAW && score < EGTB_SCORE_MATE) {
+            score += score > 0 ? -1 : 1;
+        }
+        moveScores[i].score = score;
+        bestScore = std::max(bestScore, score);
+    }
+
+    std::stable_sort(moveScores.begin(), moveScores.end(), [](const EgtbMoveScore& a, const EgtbMoveScore& b) {
+        auto sa = a.score > EGTB_SCORE_MATE ? -EGTB_SCORE_MISSING : a.score;
+        auto sb = b.score > EGTB_SCORE_MATE ? -EGTB_SCORE_MISSING : b.score;
+        return sa > sb;
+    });
+
+    return missing ? EGTB_SCORE_MISSING : bestScore;
+}
+
+int EgtbDb::getScore(EgtbFile* pEgtbFile, const EgtbBoard& board, Side side) {
+    if (pEgtbFile == nullptr) {
+        return EGTB_SCORE_MISSING;
+    }
+    pEgtbFile->checkToLoadHeaderAndTables(Side::none);
+    if (pEgtbFile->getLoadStatus() == EgtbLoadStatus::error) {
+        return EGTB_SCORE_MISSING;
+    }
+
+    auto r = pEgtbFile->getKey(board);
+    auto querySide = r.flipSide ? getXSide(side) : side;
+    if (!pEgtbFile->getHeader()->isSide(querySide)) {
+        return EGTB_SCORE_MISSING;
+    }
+    return pEgtbFile->getScore(r.key, querySide);
+}
+
+int EgtbDb::getWDL(EgtbBoard& board) {
+    return getWDL(board, board.side);
+}
+
+int EgtbDb::getWDL(EgtbBoard& board, Side side) {
+    assert(side == Side::white || side == Side::black);
+
+    auto sign = EgtbFile::computeMaterialSign(board);
+    auto score = getScore(wdlSignMap.find(sign), board, side);
+    if (score != EGTB_SCORE_MISSING) {
+        return score;
+    }
+
+    /// no WDL table, use the DTM one
+    score = getScore(signMap.find(sign), board, side);
+    return EgtbFile::scoreToWDL(score);
+}
+
+void EgtbDb::prefetch(const EgtbBoard& board) {
+    prefetch(board, board.side);
+}
+
+void EgtbDb::prefetch(const EgtbBoard& board, Side side) {
+    auto pEgtbFile = getEgtbFile(board);
+    if (pEgtbFile == nullptr || pEgtbFile->getLoadStatus() == EgtbLoadStatus::error) {
+        return;
+    }
+
+    /// headers are not loaded yet, the key can be computed only after loading them.
+    /// Only one job per file loads them, boards coming meanwhile are not prefetched
+    if (pEgtbFile->getLoadStatus() == EgtbLoadStatus::none) {
+        auto key = EgtbBlockCache::createKey(pEgtbFile->getFileId(), Side::white, (1LL << EgtbBlockCache::BlockIdxBits) - 1);
+        auto b = std::make_shared<EgtbBoard>(board);
+        submitPrefetch(key, [this, pEgtbFile, b, side]() {
+            pEgtbFile->checkToLoadHeaderAndTables(Side::none);
+            if (pEgtbFile->getLoadStatus() == EgtbLoadStatus::loaded) {
+                auto r = pEgtbFile->getKey(*b);
+                prefetch(pEgtbFile, r.key, r.flipSide ? getXSide(side) : side);
+            }
+        });
+        return;
+    }
+
+    auto r = pEgtbFile->getKey(board);
+    prefetch(pEgtbFile, r.key, r.flipSide ? getXSide(side) : side);
+}
+
+void EgtbDb::prefetch(EgtbFile* pEgtbFile, i64 idx, Side side) {
+    if (!pEgtbFile->getHeader()->isSide(side) || pEgtbFile->isProbeReady(idx, side)) {
+        return;
+    }
+
+    /// one job per block
+    auto key = EgtbBlockCache::createKey(pEgtbFile->getFileId(), side, idx / pEgtbFile->getCompressBlockItemCnt());
+    submitPrefetch(key, [pEgtbFile, idx, side]() {
+        pEgtbFile->getScore(idx, side);
+    });
+}
+
+void EgtbDb::submitPrefetch(u64 key, std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> thelock(prefetchMutex);
+        if (!prefetchKeySet.insert(key).second) {
+            return;
+        }
+    }
+
+    auto ok = prefetchPool.submit([this, key, job]() {
+        job();
+
+        std::lock_guard<std::mutex> thelock(prefetchMutex);
+        prefetchKeySet.erase(key);
+    });
+
+    if (!ok) {
+        std::lock_guard<std::mutex> thelock(prefetchMutex);
+        prefetchKeySet.erase(key);
+    }
+}
+
 i64 EgtbDb::getKey(EgtbBoard& board) {
     auto pEgtbFile = getEgtbFile(board);
     return pEgtbFile == nullptr ? -1 : pEgtbFile->getKey(board).key;
@@ -198,63 +636,8 @@ int EgtbDb::getScoreOnePly(EgtbBoard& board, Side side) {
 }
 
 
-std::string EgtbDb::getEgtbFileName(const BoardCore& board)
-{
-#ifdef _FELICITY_CHESS_
-    std::string names[2][8], wname, bname;
-    
-    for(auto sd = 0; sd < 2; sd++) {
-        for(auto i = 0; i < 16; i++) {
-            auto pos = board.pieceList[sd][i];
-            if (pos >= 0) {
-                auto piece = board.getPiece(pos);
-                assert(piece.isValid() && !piece.isEmpty());
-                auto t = static_cast<int>(piece.type);
-                names[sd][t] += Funcs::pieceTypeName[t];
-            }
-        }
-    }
-    
-    for(auto i = 0; i < 8; i++) {
-        wname += names[W][i];
-        bname += names[B][i];
-    }
-    
-    assert(wname.find('k') != std::string::npos);
-    assert(bname.find('k') != std::string::npos);
-    return wname + bname;
-
-#else
-    std::string names[2];
-    int mats[2] = { 0, 0 };
-    
-    for(auto sd = 0; sd < 2; sd++) {
-        for(auto i = 0; i < 16; i++) {
-            /// king, rook, cannon, horse, pawn, advisor, elephant
-            static int nameOrder[] = { 0, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 1, 2, 3, 4 };
-            auto j = nameOrder[i];
-            auto pos = board.pieceList[sd][j];
-
-            if (pos >= 0) {
-                auto piece = board.getPiece(pos);
-                assert(piece.isValid() && !piece.isEmpty());
-                auto t = static_cast<int>(piece.type);
-                names[sd] += Funcs::pieceTypeName[t];
-                
-                mats[sd] += t * egtbOrderPieceValue[t];
-            }
-        }
-    }
-    
-    return mats[W] >= mats[B] ? names[W] + names[B] : names[B] + names[W];
-
-#endif
-
-}
-
 EgtbFile* EgtbDb::getEgtbFile(const BoardCore& board) const {
-    auto name = EgtbDb::getEgtbFileName(board);
-    return nameMap.find(name) != nameMap.end() ? nameMap.at(name) : nullptr;
+    return signMap.find(EgtbFile::computeMaterialSign(board));
 }
 
 int EgtbDb::probe(const std::string& fenString, std::vector<MoveFull>& moveList) {
@@ -337,3 +720,147 @@ int EgtbDb::probe(EgtbBoard& board, std::vector<MoveFull>& moveList) {
     return bestScore;
 }
 
+
+////////////////////////////////////////////////////////////////////////
+// Manifest
+////////////////////////////////////////////////////////////////////////
+static const std::string manifestSignature = "#felicity-manifest\t2\t" + EGTB_MAJOR_VARIANT;
+
+static std::string joinPath(const std::string& folder, const std::string& relPath) {
+    if (folder.empty() || folder.back() == '/' || folder.back() == '\\') {
+        return folder + relPath;
+    }
+    return folder + "/" + relPath;
+}
+
+static std::string getRelativePath(const std::string& folder, const std::string& path) {
+    auto p = path.find_first_not_of("/\\", folder.size());
+    return p == std::string::npos ? "" : path.substr(p);
+}
+
+bool EgtbDb::writeManifest(const std::string& folder)
+{
+    auto vec = listdir(folder);
+    std::sort(vec.begin(), vec.end());
+
+    std::set<std::string> folderSet;
+    folderSet.insert("");
+
+    std::ostringstream fileStream;
+    auto cnt = 0;
+    for (auto && path : vec) {
+        auto egtbType = EgtbFile::getExtensionType(path);
+        if (egtbType != EgtbType::dtm && egtbType != EgtbType::wdl) {
+            continue;
+        }
+
+        EgtbFileHeader header;
+        std::ifstream file(path, std::ios::binary);
+        if (!file.read(header.getData(), header.headerSize()) || !header.isValid()) {
+            std::cerr << "Error: cannot read header of " << path << std::endl;
+            continue;
+        }
+
+        auto relPath = getRelativePath(folder, path);
+        auto name = header.getName();
+        fileStream << "f\t" << name
+                   << "\t" << (header.isSide(Side::white) ? "w" : "b")
+                   << "\t" << (egtbType == EgtbType::wdl ? "wdl" : "dtm")
+                   << "\t" << EgtbFile::computeSize(name)
+                   << "\t" << relPath << "\n";
+        cnt++;
+
+        /// adding or removing files changes times of their folders
+        for (auto p = relPath.find_first_of("/\\"); p != std::string::npos; p = relPath.find_first_of("/\\", p + 1)) {
+            folderSet.insert(relPath.substr(0, p));
+        }
+    }
+
+    /// create it first, rewriting an existing file doesn't change the time of its folder
+    auto manifestPath = joinPath(folder, EGTB_MANIFEST_NAME);
+    {
+        std::ofstream file(manifestPath, std::ios::binary | std::ios::app);
+    }
+
+    std::ostringstream stringStream;
+    stringStream << manifestSignature << "\n";
+    for (auto && relPath : folderSet) {
+        i64 fileSize, mtime;
+        if (getFileInfo(joinPath(folder, relPath), fileSize, mtime)) {
+            stringStream << "d\t" << mtime << "\t" << (relPath.empty() ? "." : relPath) << "\n";
+        }
+    }
+    stringStream << fileStream.str();
+
+    std::ofstream file(manifestPath, std::ios::binary | std::ios::trunc);
+    auto str = stringStream.str();
+    if (!file || !file.write(str.c_str(), str.size())) {
+        std::cerr << "Error: cannot write " << manifestPath << std::endl;
+        return false;
+    }
+
+    std::cout << "Manifest " << manifestPath << ", files: " << cnt << std::endl;
+    return true;
+}
+
+/// Only times of folders are checked: adding, removing or renaming files changes them. Files
+/// are not touched, their headers are verified when they are loaded
+bool EgtbDb::readManifest(const std::string& folder, std::vector<std::string>& pathVec)
+{
+    auto manifestPath = joinPath(folder, EGTB_MANIFEST_NAME);
+    std::ifstream file(manifestPath, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    std::string line;
+    if (!std::getline(file, line) || line != manifestSignature) {
+        if (egtbVerbose) {
+            std::cerr << "Error: invalid manifest " << manifestPath << std::endl;
+        }
+        return false;
+    }
+
+    pathVec.clear();
+    while (std::getline(file, line)) {
+        auto vec = Funcs::splitString(line, '\t');
+        auto isFolder = vec.size() == 3 && vec[0] == "d";
+        if (!isFolder && (vec.size() != 6 || vec[0] != "f")) {
+            if (egtbVerbose) {
+                std::cerr << "Error: invalid manifest line " << line << std::endl;
+            }
+            return false;
+        }
+
+        if (isFolder) {
+            auto path = vec[2] == "." ? folder : joinPath(folder, vec[2]);
+            i64 fileSize, mtime;
+            if (!getFileInfo(path, fileSize, mtime) || mtime != std::atoll(vec[1].c_str())) {
+                if (egtbVerbose) {
+                    std::cerr << "Warning: manifest is out of date (" << path << "), run -reindex. " << manifestPath << std::endl;
+                }
+                return false;
+            }
+            continue;
+        }
+
+        /// recorded names, sides and types must be the ones of file names, sizes the ones
+        /// of the current indexing, otherwise the manifest is from other files or versions
+        auto path = joinPath(folder, vec[5]);
+        auto fileName = getFileName(path);
+        Funcs::toLower(fileName);
+        auto egtbType = EgtbFile::getExtensionType(path);
+        auto ok = (vec[2] == "w" || vec[2] == "b")
+                && fileName == vec[1] + "." + vec[2]
+                && egtbType == (vec[3] == "wdl" ? EgtbType::wdl : EgtbType::dtm)
+                && (i64)EgtbFile::computeSize(vec[1]) == std::atoll(vec[4].c_str());
+        if (!ok) {
+            if (egtbVerbose) {
+                std::cerr << "Warning: manifest does not match (" << path << "), run -reindex. " << manifestPath << std::endl;
+            }
+            return false;
+        }
+        pathVec.push_back(path);
+    }
+    return true;
+}
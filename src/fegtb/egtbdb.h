@@ -21,21 +21,98 @@
 #include <vector>
 #include <map>
 #include <string>
+#include <mutex>
+#include <unordered_set>
 
 #include "egtb.h"
 #include "egtbfile.h"
+#include "egtbpool.h"
 
 namespace fegtb {
 
     class EgtbFile;
 
+    /// Score of a root move, from the view of the side making the move
+    class EgtbMoveScore {
+    public:
+        bslib::MoveFull move;
+        int score;
+    };
+
+    /*
+     * Flat hash table of endgames keyed by material signatures (open addressing, linear probing).
+     * Finding doesn't allocate memory nor build strings
+     */
+    class EgtbSignMap {
+    public:
+        void add(u64 sign, EgtbFile* egtbFile);
+        void clear();
+
+        EgtbFile* find(u64 sign) const {
+            if (sign == 0 || items.empty()) {
+                return nullptr;
+            }
+            auto mask = items.size() - 1;
+            for (auto k = hash(sign) & mask; ; k = (k + 1) & mask) {
+                auto& item = items[k];
+                if (item.sign == sign) {
+                    return item.egtbFile;
+                }
+                if (item.sign == 0) {
+                    return nullptr;
+                }
+            }
+        }
+
+        int getSize() const { return cnt; }
+
+    private:
+        class Item {
+        public:
+            u64 sign = 0;
+            EgtbFile* egtbFile = nullptr;
+        };
+
+        static u64 hash(u64 sign) {
+            sign *= 0x9E3779B97F4A7C15ULL;
+            return sign ^ (sign >> 29);
+        }
+
+        std::vector<Item> items;
+        int cnt = 0;
+    };
+
+    /// written into egtb folders, lists their files thus preloading needs not walk folders
+    const std::string EGTB_MANIFEST_NAME = "felicity.manifest";
+
     class EgtbDb {
     protected:
         std::vector<std::string> folders;
         std::map<std::string, EgtbFile*> nameMap;
+        EgtbSignMap signMap;
+
+        /// WDL tables, they are loaded with their own memory mode
+        std::map<std::string, EgtbFile*> wdlNameMap;
+        EgtbSignMap wdlSignMap;
+        EgtbMemMode wdlMemMode = EgtbMemMode::all;
+
+        /// RAM of all tables (not the block cache), least recently used ones are evicted
+        EgtbMemBudget memBudget;
+
+        /// background loading for prefetch, keys of pending jobs avoid duplicates
+        EgtbThreadPool prefetchPool;
+        std::mutex prefetchMutex;
+        std::unordered_set<u64> prefetchKeySet;
+
+        /// for probing groups of boards in parallel
+        EgtbThreadPool probePool;
+
+        /// for loading headers and tables in loadnow mode
+        int preloadThreadCnt = 8;
 
     public:
         std::vector<EgtbFile*> egtbFileVec;
+        std::vector<EgtbFile*> wdlFileVec;
 
     public:
         EgtbDb();
@@ -44,6 +121,29 @@ namespace fegtb {
         /// Call it to release memory
         void removeAllProbedBuffers();
 
+        /// Memory budget (bytes) of the cache of decompressed blocks, shared by all tiny mode files
+        void setCacheSize(i64 sz);
+
+        /// Cache of decompressed blocks in POSIX shared memory (such as "/fegtb_cache"), shared with
+        /// other processes opening the same name. The first process sets its size (bytes)
+        bool openSharedCache(const std::string& name, i64 sz = EgtbSharedBlockCache::DefaultSize);
+
+        /// Max number of files kept open for reading blocks
+        void setMaxOpenFiles(int n);
+
+        /// RAM budget (bytes) for data buffers and compress tables of all tables, 0 (default) for no limit.
+        /// When it is exceeded, least recently used tables are released back to header-only state
+        /// and reloaded when probed again. Set it before probing
+        void setMemoryBudget(i64 sz);
+        i64 getMemoryUsage() const {
+            return memBudget.getSize();
+        }
+
+        /// Memory mode for WDL tables (default: all), set it before preloading
+        void setWDLMemMode(EgtbMemMode memMode) {
+            wdlMemMode = memMode;
+        }
+
         int getSize() const {
             return (int)egtbFileVec.size();
         }
@@ -55,12 +155,51 @@ namespace fegtb {
         void preload(EgtbMemMode egtbMemMode = EgtbMemMode::tiny, EgtbLoadMode loadMode = EgtbLoadMode::onrequest);
         void preload(const std::string& folder, EgtbMemMode egtbMemMode, EgtbLoadMode loadMode = EgtbLoadMode::onrequest);
 
+        /// Manifest of a folder: names, sides, types and sizes (positions, not bytes) of all egtb files
+        /// and times of their folders. Preloading uses it instead of walking the folder if no folder has
+        /// changed since it was written, without touching any file, thus files replaced in place are not seen
+        static bool writeManifest(const std::string& folder);
+
         /// Scores
         int getScore(EgtbBoard& board, bslib::Side side);
         int getScore(EgtbBoard& board);
+
+        /// Scores of many boards (for their sides to move). Probes are grouped by table and side,
+        /// each needed block is decompressed once. Missing ones get EGTB_SCORE_MISSING.
+        /// Groups may be probed in parallel by the probe threads
+        void getScores(const EgtbBoard* boards, int cnt, int* scores, bool parallel = false);
+        void getScores(const std::vector<EgtbBoard>& boards, std::vector<int>& scores, bool parallel = false);
+
+        /// Scores of all legal moves of the board, best ones first. Children are probed in one
+        /// batch. Return the best score (as probe does) or EGTB_SCORE_MISSING if any is missing
+        int getMoveScores(EgtbBoard& board, std::vector<EgtbMoveScore>& moveScores, bool parallel = false);
+
+        /// Number of extra threads for parallel probing (default 3)
+        void setProbeThreads(int n);
+
+        /// Number of extra threads for loading headers and tables when preloading in loadnow mode (default 8)
+        void setPreloadThreads(int n);
         
+        /// Win/draw/loss: EGTB_WDL_WIN, EGTB_WDL_DRAW, EGTB_WDL_LOSS or EGTB_SCORE_MISSING.
+        /// WDL tables are used if available, otherwise DTM ones
+        int getWDL(EgtbBoard& board, bslib::Side side);
+        int getWDL(EgtbBoard& board);
+
         i64 getKey(EgtbBoard& board);
 
+        /// Hint that the board will be probed soon. Data it needs is loaded and decompressed
+        /// by background threads so the later probe hits the cache. It returns immediately
+        void prefetch(const EgtbBoard& board, bslib::Side side);
+        void prefetch(const EgtbBoard& board);
+
+        /// Number of background threads for prefetching (default 2), 0 to disable
+        void setPrefetchThreads(int n);
+
+        /// Counters of probing, collected only when egtbStats is true. The JSON has totals,
+        /// the block cache, open files and counters of each used table
+        std::string getStatsJson() const;
+        void resetStats();
+
         /// Probe (for getting the line of moves to win
         int probe(EgtbBoard& board, std::vector<bslib::MoveFull>& moveList);
         int probe(const std::string& fenString, std::vector<bslib::MoveFull>& moveList);
@@ -69,14 +208,30 @@ namespace fegtb {
         EgtbFile* getEgtbFile(const std::string& name);
         virtual EgtbFile* getEgtbFile(const bslib::BoardCore& board) const;
 
+        /// Quick checks if there is an endgame for the material of the board, no memory allocated
+        bool isAvailable(const bslib::BoardCore& board) const {
+            return signMap.find(EgtbFile::computeMaterialSign(board)) != nullptr;
+        }
+        bool isAvailable(u64 materialSign) const {
+            return signMap.find(materialSign) != nullptr;
+        }
+
         void closeAll();
 
     protected:
-        static std::string getEgtbFileName(const bslib::BoardCore& board);
+        void prefetch(EgtbFile* pEgtbFile, i64 idx, bslib::Side side);
+        void submitPrefetch(u64 key, std::function<void()> job);
+
+        /// paths from a valid manifest, false if it is missing or out of date
+        static bool readManifest(const std::string& folder, std::vector<std::string>& pathVec);
 
         void addEgtbFile(EgtbFile *egtbFile);
+        void addWDLFile(EgtbFile *egtbFile);
         bool verifyEgtbFileSides() const;
 
+        /// EGTB_SCORE_MISSING if the file can't answer
+        static int getScore(EgtbFile* pEgtbFile, const EgtbBoard& board, bslib::Side side);
+
         int getScoreOnePly(EgtbBoard& board, bslib::Side side);
 
     };
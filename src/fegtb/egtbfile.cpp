@@ -18,10 +18,12 @@
 #include <fstream>
 #include <iomanip>
 #include <ctime>
+#include <atomic>
 
 #include "egtb.h"
 #include "egtbfile.h"
 #include "egtbkey.h"
+#include "egtbgrammar.h"
 
 #include "../base/funcs.h"
 
@@ -33,6 +35,7 @@ using namespace bslib;
 const char* EgtbFile::egtbFileExtensions[] = {
     ".fegtb",           /// .dtm / main extension
     ".fegtb_tmp",       /// .tmp / extension for temporary data
+    ".fegtb_wdl",       /// .wdl / win-draw-loss tables, derived from .dtm ones
     nullptr
 };
 #else
@@ -40,6 +43,7 @@ const char* EgtbFile::egtbFileExtensions[] = {
 const char* EgtbFile::egtbFileExtensions[] = {
     ".fexq",            /// .dtm / main extension
     ".fexq_tmp",        /// .tmp / extension for temporary data
+    ".fexq_wdl",        /// .wdl / win-draw-loss tables, derived from .dtm ones
     nullptr
 };
 
@@ -49,8 +53,10 @@ const char* EgtbFile::egtbFileExtensions[] = {
 EgtbType EgtbFile::getExtensionType(const std::string& path) {
     auto p = EgtbType::none;
 
+    /// match the end of the path since the main extension is a prefix of the others
     for (int i = 0; egtbFileExtensions[i]; i++) {
-        if (path.find(egtbFileExtensions[i]) != std::string::npos) {
+        std::string ext = egtbFileExtensions[i];
+        if (path.size() >= ext.size() && path.compare(path.size() - ext.size(), ext.size(), ext) == 0) {
             p = static_cast<EgtbType>(i);
             break;
         }
@@ -62,14 +68,29 @@ EgtbType EgtbFile::getExtensionType(const std::string& path) {
 //////////////////////////////////////////////////////////////////////
 // Construction/Destruction
 //////////////////////////////////////////////////////////////////////
+/// ids are not reused, up to EgtbBlockCache::MaxFileId (2^31 - 1) of them fit keys of the block cache
+static std::atomic<u32> egtbFileIdCounter(0);
+
 EgtbFile::EgtbFile(const std::string& name, int order)
 {
-    pBuf[0] = pBuf[1] = pCompressBuf = nullptr;
+    fileId = ++egtbFileIdCounter;
+    materialsign = 0;
+
+    pBuf[0] = pBuf[1] = nullptr;
     compressBlockTables[0] = compressBlockTables[1] = nullptr;
+    compressDicts[0] = compressDicts[1] = nullptr;
+    compressDictSizes[0] = compressDictSizes[1] = 0;
+    grammars[0] = grammars[1] = nullptr;
+    sharedIds[0] = sharedIds[1] = 0;
+
+    mapData[0] = mapData[1] = nullptr;
+    mapSize[0] = mapSize[1] = 0;
+    mapHandle[0] = mapHandle[1] = nullptr;
 
     header = nullptr;
     memMode = EgtbMemMode::tiny;
     loadStatus = EgtbLoadStatus::none;
+    dataLoaded[0] = dataLoaded[1] = false;
     reset();
     
     if (!name.empty()) {
@@ -78,6 +99,11 @@ EgtbFile::EgtbFile(const std::string& name, int order)
 }
 
 EgtbFile::~EgtbFile() {
+    /// first, thus the budget can't evict it while it is being destroyed
+    if (memBudget) {
+        memBudget->remove(this);
+        memBudget = nullptr;
+    }
     removeBuffers();
     
     if (header) {
@@ -96,12 +122,18 @@ void EgtbFile::reset() {
 }
 
 void EgtbFile::removeBuffers() {
-    if (pCompressBuf) free(pCompressBuf);
-    pCompressBuf = nullptr;
+    egtbBlockCache.removeFile(fileId);
+    for (auto && p : path) {
+        if (!p.empty()) {
+            egtbFileHandleCache.close(p);
+        }
+    }
 
     for (auto i = 0; i < 2; i++) {
+        dataLoaded[i] = false;
+
         if (pBuf[i]) {
-            free(pBuf[i]);
+            freeBuffer(pBuf[i]);
             pBuf[i] = nullptr;
         }
 
@@ -109,11 +141,187 @@ void EgtbFile::removeBuffers() {
             free(compressBlockTables[i]);
             compressBlockTables[i] = nullptr;
         }
+        if (compressDicts[i]) {
+            free(compressDicts[i]);
+            compressDicts[i] = nullptr;
+        }
+        compressDictSizes[i] = 0;
+        if (grammars[i]) {
+            delete grammars[i];
+            grammars[i] = nullptr;
+        }
+        sharedIds[i] = 0;
         
         startpos[i] = endpos[i] = 0;
     }
 
+    unmapFileData();
+
     loadStatus = EgtbLoadStatus::none;
+
+    /// the budget evicting the file holds its lock and uncharges it itself
+    if (memBudget && !evicting.load()) {
+        memBudget->remove(this);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+// Memory budget
+//////////////////////////////////////////////////////////////////////
+void EgtbFile::setMemBudget(EgtbMemBudget* budget)
+{
+    if (memBudget) {
+        memBudget->remove(this);
+    }
+    memBudget = budget;
+    if (memBudget) {
+        memBudget->charge(this, getMemoryUsage());
+    }
+}
+
+i64 EgtbFile::getMemoryUsage() const
+{
+    if (header == nullptr) {
+        return 0;
+    }
+
+    i64 sz = 0;
+    for (auto sd = 0; sd < 2; sd++) {
+        if (pBuf[sd]) {
+            sz += getDataSize();
+        }
+        if (compressBlockTables[sd]) {
+            sz += getBlockTableSize(static_cast<Side>(sd));
+        }
+        if (compressDicts[sd]) {
+            sz += compressDictSizes[sd];
+        }
+        if (grammars[sd]) {
+            sz += grammars[sd]->getMemoryUsage();
+        }
+    }
+    return sz;
+}
+
+void EgtbFile::chargeMemory()
+{
+    if (memBudget) {
+        memBudget->charge(this, getMemoryUsage());
+    }
+}
+
+bool EgtbFile::pin()
+{
+    if (!memBudget) {
+        return false;
+    }
+
+    lastAccess.store(memBudget->tick(), std::memory_order_relaxed);
+    pinCnt.fetch_add(1);
+
+    /// being evicted, wait until it is done (the evictor holds mtx)
+    while (evicting.load()) {
+        pinCnt.fetch_sub(1);
+        {
+            std::lock_guard<std::mutex> thelock(mtx);
+        }
+        pinCnt.fetch_add(1);
+    }
+    return true;
+}
+
+void EgtbFile::unpin()
+{
+    pinCnt.fetch_sub(1);
+}
+
+bool EgtbFile::evict()
+{
+    /// never wait here, the caller may hold locks of other files
+    std::unique_lock<std::mutex> thelock(mtx, std::try_to_lock);
+    if (!thelock.owns_lock()) {
+        return false;
+    }
+    std::unique_lock<std::mutex> lock0(sdmtx[0], std::try_to_lock), lock1(sdmtx[1], std::try_to_lock);
+    if (!lock0.owns_lock() || !lock1.owns_lock()) {
+        return false;
+    }
+
+    evicting.store(true);
+    auto r = pinCnt.load() == 0;
+    if (r) {
+        removeBuffers();
+    }
+    evicting.store(false);
+    return r;
+}
+
+/// Keeps the file from being evicted while probing
+class EgtbFilePinGuard {
+public:
+    EgtbFilePinGuard(EgtbFile* egtbFile) {
+        pinned = egtbFile->pin() ? egtbFile : nullptr;
+    }
+    ~EgtbFilePinGuard() {
+        if (pinned) {
+            pinned->unpin();
+        }
+    }
+
+private:
+    EgtbFile* pinned;
+};
+
+bool EgtbFile::mapFileData(Side side)
+{
+    auto sd = static_cast<int>(side);
+    if (mapData[sd]) {
+        return true;
+    }
+
+    mapData[sd] = mapFile(getPath(side), mapSize[sd], &mapHandle[sd]);
+    if (mapData[sd] == nullptr) {
+        if (egtbVerbose) {
+            std::cerr << "Error: cannot map file " << getPath(side) << std::endl;
+        }
+        return false;
+    }
+
+    /// the file must be large enough for all data, otherwise probes could read out of the mapping.
+    /// Compressed data starts after the compress table and the dictionary / grammar, as loadBlock reads it
+    i64 requiredSz = header->headerSize() + getDataSize();
+    if (isCompressed()) {
+        auto blockCnt = getCompresseBlockCount();
+        i64 blockOffset; int compDataSz;
+        getCompressedBlockInfo(blockCnt - 1, side, blockOffset, compDataSz);
+        requiredSz = getCompressedDataOffset(side) + blockOffset + compDataSz;
+    }
+
+    if (mapSize[sd] < requiredSz) {
+        if (egtbVerbose) {
+            std::cerr << "Error: file is too small (truncated?) " << getPath(side) << std::endl;
+        }
+        unmapFile(mapData[sd], mapSize[sd], mapHandle[sd]);
+        mapData[sd] = nullptr; mapSize[sd] = 0; mapHandle[sd] = nullptr;
+        return false;
+    }
+
+    if (egtbStats) {
+        stats.add(side, EgtbStats::dataLoads);
+    }
+    return true;
+}
+
+void EgtbFile::unmapFileData()
+{
+    for (auto i = 0; i < 2; i++) {
+        if (mapData[i]) {
+            unmapFile(mapData[i], mapSize[i], mapHandle[i]);
+        }
+        mapData[i] = nullptr;
+        mapSize[i] = 0;
+        mapHandle[i] = nullptr;
+    }
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -136,13 +344,14 @@ bool EgtbFile::createBuf(i64 len, Side side)
 {
     auto sd = static_cast<int>(side);
     
-    pBuf[sd] = (char *)malloc((size_t)len + 16);
+    freeBuffer(pBuf[sd]);
+    pBuf[sd] = allocBuffer(len + 16);
     startpos[sd] = 0; endpos[sd] = 0;
     return pBuf[sd];
 }
 
 i64 EgtbFile::getBufItemCnt() const {
-    if (memMode == EgtbMemMode::tiny) {
+    if (memMode == EgtbMemMode::tiny || memMode == EgtbMemMode::mmap) {
         return getCompressBlockSize();
     }
     return getSize();
@@ -160,20 +369,23 @@ bool EgtbFile::preload(const std::string& path, EgtbMemMode _memMode, EgtbLoadMo
     loadMode = _loadMode;
 
     loadStatus = EgtbLoadStatus::none;
-    if (loadMode == EgtbLoadMode::onrequest) {
-        auto theName = getFileName(path);
-        if (theName.length() < 4) {
-            assert(false);
-            return false;
-        }
-        Funcs::toLower(theName);
-        auto loadingSide = theName.find(".w") != std::string::npos ? Side::white : Side::black;
-        setPath(path, loadingSide);
 
-        theName = theName.substr(0, theName.length() - 2); // remove .w, .b
-        egtbName = theName;
-        egtbType = EgtbType::dtm;
+    /// the name is needed by both modes, loading checks it with the one in the header
+    auto theName = getFileName(path);
+    if (theName.length() < 4) {
+        assert(false);
+        return false;
+    }
+    Funcs::toLower(theName);
+    auto loadingSide = theName.find(".w") != std::string::npos ? Side::white : Side::black;
+    setPath(path, loadingSide);
+
+    theName = theName.substr(0, theName.length() - 2); // remove .w, .b
+    egtbName = theName;
+    egtbType = getExtensionType(path);
+    materialsign = computeMaterialSign(egtbName);
 
+    if (loadMode == EgtbLoadMode::onrequest) {
         if (egtbName.empty()) {
             setupIdxComputing(getName(), 0);
         }
@@ -207,12 +419,20 @@ bool EgtbFile::loadHeaderAndTable(const std::string& path) {
             oldProperty = header->getProperty();
         }
         auto loadingSide = Side::none;
-        
+
+        /// the block size is stored once for both sides, they must agree
+        auto oldBlockSize = (oldProperty & (EGTB_PROP_SIDE_BLACK | EGTB_PROP_SIDE_WHITE)) ? header->getCompressBlockSize() : 0;
+
         if (readHeader(file) && egtbName == header->getName()) {
+            if (oldBlockSize && oldBlockSize != header->getCompressBlockSize()) {
+                std::cerr << "Error: block size " << header->getCompressBlockSize() << " of " << path
+                          << " differs from the one of the other side " << oldBlockSize << std::endl;
+                return false;
+            }
             header->addProperty(oldProperty);
             loadingSide = path.find(".w.") != std::string::npos ? Side::white : Side::black;
 
-            egtbType = EgtbType::dtm;
+            egtbType = getExtensionType(path);
 
             setPath(path, loadingSide);
             //header->setOnlySide(loadingSide);
@@ -229,6 +449,11 @@ bool EgtbFile::loadHeaderAndTable(const std::string& path) {
             }
         }
 
+        if (r && egtbStats) {
+            stats.add(loadingSide, EgtbStats::headerLoads);
+            stats.add(loadingSide, EgtbStats::bytesRead, header->headerSize() + (isCompressed() ? getBlockTableSize(loadingSide) : 0));
+        }
+
         if (r && isCompressed()) {
             if (!readCompressTable(file, loadingSide)) {
                 if (egtbVerbose) {
@@ -242,6 +467,10 @@ bool EgtbFile::loadHeaderAndTable(const std::string& path) {
             r = loadAllData(file, loadingSide);
 
         }
+
+        if (r && memMode == EgtbMemMode::mmap) {
+            r = mapFileData(loadingSide);
+        }
         file.close();
     }
 
@@ -267,14 +496,39 @@ void EgtbFile::merge(EgtbFile& otherEgtbFile)
         }
 
         if (otherEgtbFile.header && otherEgtbFile.header->isSide(side)) {
+            if (otherEgtbFile.header->getCompressBlockSize() != header->getCompressBlockSize()) {
+                std::cerr << "Error: block size " << otherEgtbFile.header->getCompressBlockSize() << " of " << otherEgtbFile.getPath(side)
+                          << " differs from the one of the other side " << header->getCompressBlockSize() << std::endl;
+                loadStatus = EgtbLoadStatus::error;
+                continue;
+            }
 
             header->addSide(side);
+            /// formats of compress tables and blocks depend on those properties of their sides
+            auto sideProps = EGTB_PROP_LARGE_COMPRESSTABLE_B | EGTB_PROP_2LEVEL_COMPRESSTABLE_B | EGTB_PROP_CODEC_LZ_B | EGTB_PROP_DICT_B | EGTB_PROP_CODEC_GRAMMAR_B;
+            header->addProperty(otherEgtbFile.header->getProperty() & (sideProps << sd));
             setPath(otherEgtbFile.getPath(side), side);
 
             if (compressBlockTables[sd]) {
                 free(compressBlockTables[sd]);
             }
             compressBlockTables[sd] = otherEgtbFile.compressBlockTables[sd];
+            otherEgtbFile.compressBlockTables[sd] = nullptr;
+
+            if (compressDicts[sd]) {
+                free(compressDicts[sd]);
+            }
+            compressDicts[sd] = otherEgtbFile.compressDicts[sd];
+            compressDictSizes[sd] = otherEgtbFile.compressDictSizes[sd];
+            otherEgtbFile.compressDicts[sd] = nullptr;
+            otherEgtbFile.compressDictSizes[sd] = 0;
+
+            if (grammars[sd]) {
+                delete grammars[sd];
+            }
+            grammars[sd] = otherEgtbFile.grammars[sd];
+            otherEgtbFile.grammars[sd] = nullptr;
+            sharedIds[sd] = 0;
 
             if (pBuf[sd] == nullptr && otherEgtbFile.pBuf[sd] != nullptr) {
                 pBuf[sd] = otherEgtbFile.pBuf[sd];
@@ -284,10 +538,21 @@ void EgtbFile::merge(EgtbFile& otherEgtbFile)
                 otherEgtbFile.pBuf[sd] = nullptr;
                 otherEgtbFile.startpos[sd] = 0;
                 otherEgtbFile.endpos[sd] = 0;
-                otherEgtbFile.compressBlockTables[sd] = nullptr;
+            }
+
+            if (mapData[sd] == nullptr && otherEgtbFile.mapData[sd] != nullptr) {
+                mapData[sd] = otherEgtbFile.mapData[sd];
+                mapSize[sd] = otherEgtbFile.mapSize[sd];
+                mapHandle[sd] = otherEgtbFile.mapHandle[sd];
+
+                otherEgtbFile.mapData[sd] = nullptr;
+                otherEgtbFile.mapSize[sd] = 0;
+                otherEgtbFile.mapHandle[sd] = nullptr;
             }
         }
     }
+
+    chargeMemory();
 }
 
 bool EgtbFile::readCompressTable(std::ifstream& file, Side loadingSide) {
@@ -309,6 +574,57 @@ bool EgtbFile::readCompressTable(std::ifstream& file, Side loadingSide) {
         compressBlockTables[sd] = nullptr;
         return false;
     }
+
+    if (hasCompressDict(loadingSide)) {
+        assert(compressDicts[sd] == nullptr && grammars[sd] == nullptr);
+        auto isGrammar = getCodec(loadingSide) == EgtbCodec::grammar;
+        u32 dictSz = 0;
+        if (!file.read((char *)&dictSz, sizeof(dictSz)) || dictSz == 0
+            || dictSz > u32(isGrammar ? EGTB_GRAMMAR_MAX_SIZE : EGTB_LZ_MAX_DICT_SIZE)) {
+            if (egtbVerbose) {
+                std::cerr << "Error: invalid compress dictionary from path " << path << std::endl;
+            }
+            file.close();
+            free(compressBlockTables[sd]);
+            compressBlockTables[sd] = nullptr;
+            return false;
+        }
+
+        compressDicts[sd] = (char*)malloc(dictSz);
+        compressDictSizes[sd] = (int)dictSz;
+        if (!file.read(compressDicts[sd], dictSz)) {
+            if (egtbVerbose) {
+                std::cerr << "Error: cannot read compress dictionary from path " << path << std::endl;
+            }
+            file.close();
+            free(compressBlockTables[sd]);
+            compressBlockTables[sd] = nullptr;
+            free(compressDicts[sd]);
+            compressDicts[sd] = nullptr;
+            compressDictSizes[sd] = 0;
+            return false;
+        }
+
+        /// grammars are used parsed, only their sizes are kept for data offsets
+        if (isGrammar) {
+            auto grammar = new EgtbGrammar;
+            auto ok = grammar->load(compressDicts[sd], (int)dictSz);
+            free(compressDicts[sd]);
+            compressDicts[sd] = nullptr;
+            if (!ok) {
+                if (egtbVerbose) {
+                    std::cerr << "Error: invalid grammar from path " << path << std::endl;
+                }
+                delete grammar;
+                file.close();
+                free(compressBlockTables[sd]);
+                compressBlockTables[sd] = nullptr;
+                compressDictSizes[sd] = 0;
+                return false;
+            }
+            grammars[sd] = grammar;
+        }
+    }
     return true;
 }
 
@@ -320,51 +636,78 @@ bool EgtbFile::loadAllData(std::ifstream& file, Side side) {
     startpos[sd] = endpos[sd] = 0;
 
     auto sz = getSize();
-    auto bufSz = sz;
-    if (isTwoBytes()) bufSz += bufSz;
+    auto bufSz = getDataSize();
     createBuf(bufSz, side); assert(pBuf[sd]);
 
     if (isCompressed()) {
         const auto compressBlockSz = getCompressBlockSize();
-        auto blockCnt = (int)((bufSz + compressBlockSz - 1) / compressBlockSz);
-        auto blockTableItemSize = (header->getProperty() & (EGTB_PROP_LARGE_COMPRESSTABLE_B << sd)) != 0 ? 5 : 4;
-        auto blockTableSz = blockCnt * blockTableItemSize;
-        
-        i64 compDataSz;
+        auto blockCnt = getCompresseBlockCount();
 
         assert(compressBlockTables[sd]);
-        u8 *p = compressBlockTables[sd] + blockTableItemSize * (blockCnt - 1);
-        if (blockTableItemSize == 4) {
-            u32 sz = *(u32*)p;
-            sz &= u32(EGTB_SMALL_COMPRESS_SIZE);
-            compDataSz = sz;
-        } else {
-            compDataSz = *(i64*)p & EGTB_LARGE_COMPRESS_SIZE;
-        }
-        assert(compDataSz > 0 && compDataSz <= getSize());
+        i64 lastBlockOffset; int lastCompDataSz;
+        getCompressedBlockInfo(blockCnt - 1, side, lastBlockOffset, lastCompDataSz);
+        i64 compDataSz = lastBlockOffset + lastCompDataSz;
+        assert(compDataSz > 0 && compDataSz <= bufSz);
 
         char* tempBuf = (char*) malloc(compDataSz + 64);
         
-        assert(blockTableSz == getBlockTableSize(side));
-        i64 seekpos = header->headerSize() + blockTableSz;
+        i64 seekpos = getCompressedDataOffset(side);
         file.seekg(seekpos, std::ios::beg);
 
+        auto ok = false;
         if (file.read(tempBuf, compDataSz)) {
-            auto originSz = decompressAllBlocks(compressBlockSz, blockCnt, (u32*)compressBlockTables[sd], (char*)pBuf[sd], bufSz, tempBuf, compDataSz);
-            assert(originSz == bufSz);
+            auto startTime = egtbStats ? EgtbStats::now() : 0;
+
+            /// block by block, compress tables may be in any format
+            ok = true;
+            for (i64 blockIdx = 0; blockIdx < blockCnt && ok; blockIdx++) {
+                i64 blockOffset; int blockCompDataSz;
+                auto iscompressed = getCompressedBlockInfo(blockIdx, side, blockOffset, blockCompDataSz);
+                auto originSz = (int)std::min<i64>(compressBlockSz, bufSz - blockIdx * compressBlockSz);
+                ok = decompressBlock(side, tempBuf + blockOffset, blockCompDataSz, iscompressed, pBuf[sd] + blockIdx * compressBlockSz, originSz) == originSz;
+            }
 
-            endpos[sd] = sz;
+            if (ok) {
+                endpos[sd] = sz;
+            }
+
+            if (egtbStats) {
+                stats.add(side, EgtbStats::decompressNs, EgtbStats::now() - startTime);
+                stats.add(side, EgtbStats::blocksDecompressed, blockCnt);
+                stats.add(side, EgtbStats::bytesRead, compDataSz);
+                stats.add(side, EgtbStats::dataLoads);
+            }
         }
 
         free(tempBuf);
         free(compressBlockTables[sd]);
         compressBlockTables[sd] = nullptr;
+        if (compressDicts[sd]) {
+            free(compressDicts[sd]);
+            compressDicts[sd] = nullptr;
+        }
+        compressDictSizes[sd] = 0;
+        if (grammars[sd]) {
+            delete grammars[sd];
+            grammars[sd] = nullptr;
+        }
+
+        /// compress tables are gone, the file can't be read again
+        if (!ok) {
+            std::cerr << "Error: corrupted or truncated data of " << getPath(side) << std::endl;
+            loadStatus = EgtbLoadStatus::error;
+        }
     } else {
         i64 seekpos = header->headerSize();
         file.seekg(seekpos, std::ios::beg);
 
         if (file.read(pBuf[sd], bufSz)) {
             endpos[sd] = sz;
+
+            if (egtbStats) {
+                stats.add(side, EgtbStats::bytesRead, bufSz);
+                stats.add(side, EgtbStats::dataLoads);
+            }
         }
     }
 
@@ -375,82 +718,81 @@ bool EgtbFile::loadAllData(std::ifstream& file, Side side) {
 void EgtbFile::checkToLoadHeaderAndTables(Side side) {
     auto sd = static_cast<int>(side);
 
-    if (loadStatus != EgtbLoadStatus::none || (sd < 2 && path[sd].empty())) {
-        return;
-    }
-
-    std::lock_guard<std::mutex> thelock(mtx);
-    
-    if (loadStatus != EgtbLoadStatus::none || (sd < 2 && path[sd].empty())) {
+    if (loadStatus.load(std::memory_order_acquire) != EgtbLoadStatus::none || (sd < 2 && path[sd].empty())) {
         return;
     }
 
-    auto r = true;
-    if (sd < 2) {
-        assert(!path[sd].empty());
-        r = loadHeaderAndTable(path[sd]);
-    } else {
-        if (path[0].empty() || path[1].empty()) {
-            std::cerr << "Error: missing a path for " << getName() << std::endl;
+    {
+        auto startTime = egtbStats ? EgtbStats::now() : 0;
+        std::lock_guard<std::mutex> thelock(mtx);
+        if (egtbStats) {
+            stats.add(sd < 2 ? side : Side::white, EgtbStats::lockWaitNs, EgtbStats::now() - startTime);
         }
-        if (r && !path[1].empty()) {
-            r = loadHeaderAndTable(path[1]);
+
+        if (loadStatus.load(std::memory_order_relaxed) != EgtbLoadStatus::none || (sd < 2 && path[sd].empty())) {
+            return;
         }
-        if (!path[0].empty()) {
-            r = loadHeaderAndTable(path[0]);
+
+        auto r = true;
+        if (sd < 2) {
+            assert(!path[sd].empty());
+            r = loadHeaderAndTable(path[sd]);
+        } else {
+            if (path[0].empty() || path[1].empty()) {
+                std::cerr << "Error: missing a path for " << getName() << std::endl;
+            }
+            if (r && !path[1].empty()) {
+                r = loadHeaderAndTable(path[1]);
+            }
+            /// keep the failure of the other side
+            if (!path[0].empty()) {
+                r = loadHeaderAndTable(path[0]) && r;
+            }
         }
+
+        loadStatus.store(r ? EgtbLoadStatus::loaded : EgtbLoadStatus::error, std::memory_order_release);
     }
 
-    loadStatus = r ? EgtbLoadStatus::loaded : EgtbLoadStatus::error;
+    /// out of the lock, charging may evict other files
+    chargeMemory();
 }
 
 bool EgtbFile::forceLoadHeaderAndTable(Side side) {
-    std::lock_guard<std::mutex> thelock(mtx);
+    bool r;
+    {
+        std::lock_guard<std::mutex> thelock(mtx);
 
-    auto sd = static_cast<int>(side);
-    bool r = !path[sd].empty() && loadHeaderAndTable(path[sd]);
-    loadStatus = r ? EgtbLoadStatus::loaded : EgtbLoadStatus::error;
+        auto sd = static_cast<int>(side);
+        r = !path[sd].empty() && loadHeaderAndTable(path[sd]);
+        loadStatus = r ? EgtbLoadStatus::loaded : EgtbLoadStatus::error;
+    }
+    chargeMemory();
     return r;
 }
 
-bool EgtbFile::readBuf(i64 idx, Side side)
+/// Load data for modes which don't use the block cache
+bool EgtbFile::readBuf(Side side)
 {
-    auto sd = static_cast<int>(side);
-    if (!pBuf[sd]) {
-        auto bufSz = getBufSize();
-        createBuf(bufSz, side);
+    assert(!isUsingBlockCache());
+
+    /// uncompressed data in mmap mode is read directly from the mapping
+    if (memMode == EgtbMemMode::mmap) {
+        return mapData[static_cast<int>(side)] != nullptr;
+    }
+
+    /// data of the side failed to load before
+    if (loadStatus == EgtbLoadStatus::error) {
+        return false;
     }
 
+    /// loadAllData creates the buffer
     auto r = false;
     std::ifstream file(getPath(side), std::ios::binary);
     if (file) {
-        if (memMode == EgtbMemMode::all) {
-            r = loadAllData(file, side);
-        } else if (isCompressed() && compressBlockTables[sd]) {
-            r = readCompressedBlock(file, idx, side, (char*)pBuf[sd]);
-        } else {
-            auto bufCnt = std::min<i64>(getBufItemCnt(), getSize() - idx);
-
-            auto beginIdx = (idx + bufCnt <= getSize()) ? idx : 0;
-            auto x = beginIdx;
-            
-            auto bufsz = bufCnt;
-            if (isTwoBytes()) {
-                bufsz += bufsz;
-                x += beginIdx;
-            }
-
-            i64 seekpos = header->headerSize() + x;
-            file.seekg(seekpos, std::ios::beg);
-
-            if (file.read(pBuf[sd], bufsz)) {
-                startpos[sd] = beginIdx;
-                endpos[sd] = beginIdx + bufCnt;
-                r = true;
-            }
-        }
+        r = loadAllData(file, side);
     }
     file.close();
+    chargeMemory();
 
     if (!r && egtbVerbose) {
         std::cerr << "Error: Cannot open file " << getPath(side) << std::endl;
@@ -459,51 +801,228 @@ bool EgtbFile::readBuf(i64 idx, Side side)
     return r;
 }
 
-bool EgtbFile::readCompressedBlock(std::ifstream& file, i64 idx, Side side, char* pDest)
+/// Return true if the block is compressed, false if it is stored as it is
+bool EgtbFile::getCompressedBlockInfo(i64 blockIdx, Side side, i64& blockOffset, int& compDataSz) const
 {
     auto sd = static_cast<int>(side);
-    auto blockCnt = getCompresseBlockCount();
-    int blockTableSz = blockCnt * sizeof(u32);
+    assert(compressBlockTables[sd] && blockIdx >= 0 && blockIdx < getCompresseBlockCount());
 
-    const int compressBlockSz = getCompressBlockSize();
-    const int blockSize = isTwoBytes() ? compressBlockSz / 2 : compressBlockSz;
-    auto blockIdx = idx / blockSize;
-    startpos[sd] = endpos[sd] = blockIdx * blockSize;
+    if (isTwoLevelCompressTable(side)) {
+        auto groupCnt = (getCompresseBlockCount() + EGTB_2LEVEL_GROUP_BLOCKS - 1) / EGTB_2LEVEL_GROUP_BLOCKS;
+        auto groupTable = (const i64*)compressBlockTables[sd];
+        auto sizeTable = (const u16*)(compressBlockTables[sd] + groupCnt * sizeof(i64));
 
-    u32* table = (u32*)compressBlockTables[sd];
-    assert(table);
-    
-    auto iscompressed = !(table[blockIdx] & EGTB_UNCOMPRESS_BIT);
-    u32 blockOffset = blockIdx == 0 ? 0 : (table[blockIdx - 1] & u32(EGTB_SMALL_COMPRESS_SIZE));
-    u32 compDataSz = (table[blockIdx] & u32(EGTB_SMALL_COMPRESS_SIZE)) - blockOffset;
+        auto groupStartIdx = blockIdx - blockIdx % EGTB_2LEVEL_GROUP_BLOCKS;
+        blockOffset = groupTable[blockIdx / EGTB_2LEVEL_GROUP_BLOCKS];
+        for (auto i = groupStartIdx; i < blockIdx; i++) {
+            blockOffset += sizeTable[i] & ~EGTB_2LEVEL_UNCOMPRESS_BIT;
+        }
+        compDataSz = sizeTable[blockIdx] & ~EGTB_2LEVEL_UNCOMPRESS_BIT;
+        return !(sizeTable[blockIdx] & EGTB_2LEVEL_UNCOMPRESS_BIT);
+    }
 
-    assert(compDataSz <= blockSize);
+    if (isLargeCompressTable(side)) {
+        const u8* p = compressBlockTables[sd] + blockIdx * 5;
+        i64 item = *(i64*)p;
+        blockOffset = blockIdx == 0 ? 0 : (*(i64*)(p - 5) & EGTB_LARGE_COMPRESS_SIZE);
+        compDataSz = (int)((item & EGTB_LARGE_COMPRESS_SIZE) - blockOffset);
+        return !(item & EGTB_UNCOMPRESS_BIT_FOR_LARGE_COMPRESSTABLE);
+    }
 
-    i64 seekpos = header->headerSize() + blockTableSz + blockOffset;
-    file.seekg(seekpos, std::ios::beg);
+    const u32* table = (const u32*)compressBlockTables[sd];
+    blockOffset = blockIdx == 0 ? 0 : (table[blockIdx - 1] & u32(EGTB_SMALL_COMPRESS_SIZE));
+    compDataSz = (int)((table[blockIdx] & u32(EGTB_SMALL_COMPRESS_SIZE)) - blockOffset);
+    return !(table[blockIdx] & EGTB_UNCOMPRESS_BIT);
+}
 
+/// Decompress (or copy if the block is stored as it is) a block into pDest, return the data size
+int EgtbFile::decompressBlock(Side side, const char* src, int compDataSz, bool iscompressed, char* pDest, int originSz) const
+{
+    assert(compDataSz > 0 && originSz > 0);
     if (iscompressed) {
-        if (pCompressBuf == nullptr) {
-            pCompressBuf = (char*) malloc(blockSize * 3 / 2);
-        }
-        if (file.read(pCompressBuf, compDataSz)) {
-            auto m = getSize() - startpos[sd];
-            if (isTwoBytes()) m += m;
-            auto curBlockSize = (int)std::min<i64>(m, (i64)compressBlockSz);
-            auto originSz = decompress(pDest, curBlockSize, pCompressBuf, compDataSz);
-            endpos[sd] += isTwoBytes() ? originSz / 2 : originSz;
-            assert(originSz <= getBufSize());
-            return true;
-        }
-    } else if (file.read(pDest, compDataSz)) {
-        endpos[sd] += isTwoBytes() ? compDataSz / 2 : compDataSz;
+        auto sd = static_cast<int>(side);
+        switch (getCodec(side)) {
+            case EgtbCodec::lz:
+                return decompressLz(pDest, originSz, src, compDataSz, compressDicts[sd], compressDictSizes[sd]);
+            case EgtbCodec::grammar:
+                return grammars[sd] ? grammars[sd]->decodeBlock(src, compDataSz, pDest, originSz) : -1;
+            default:
+                return decompress(pDest, originSz, src, compDataSz);
+        }
+    }
+
+    if (compDataSz != originSz) {
+        return -1;
+    }
+    memcpy(pDest, src, compDataSz);
+    return compDataSz;
+}
+
+EgtbBlockPtr EgtbFile::getBlock(i64 idx, Side side)
+{
+    auto blockIdx = idx / getCompressBlockItemCnt();
+    auto key = EgtbBlockCache::createKey(fileId, side, blockIdx);
+
+    auto block = egtbBlockCache.find(key);
+    if (egtbStats) {
+        stats.add(side, block ? EgtbStats::cacheHits : EgtbStats::cacheMisses);
+    }
+
+    if (!block) {
+        /// decompressed by another process
+        auto shared = egtbSharedBlockCache.isOpen();
+        if (shared) {
+            block = egtbSharedBlockCache.find(getSharedId(side), blockIdx);
+            if (block && egtbStats) {
+                stats.add(side, EgtbStats::sharedCacheHits);
+            }
+        }
+
+        if (!block) {
+            block = loadBlock(blockIdx, side);
+            if (block && shared) {
+                egtbSharedBlockCache.add(getSharedId(side), blockIdx, *block);
+            }
+        }
+
+        if (block) {
+            block = egtbBlockCache.add(key, block);
+        }
+    }
+    return block;
+}
+
+u64 EgtbFile::getSharedId(Side side)
+{
+    auto sd = static_cast<int>(side);
+    auto id = sharedIds[sd].load(std::memory_order_relaxed);
+    if (id == 0) {
+        /// a rewritten file gets a new id
+        i64 fileSize = 0, mtime = 0;
+        getFileInfo(getPath(side), fileSize, mtime);
+        id = materialsign;
+        for (auto v : { (u64)getEgtbType(), (u64)sd, (u64)fileSize, (u64)mtime }) {
+            id = (id ^ v) * 0x9E3779B97F4A7C15ULL;
+            id ^= id >> 29;
+        }
+        id |= 1;
+        sharedIds[sd].store(id, std::memory_order_relaxed);
+    }
+    return id;
+}
+
+EgtbBlockPtr EgtbFile::loadBlock(i64 blockIdx, Side side)
+{
+    auto sd = static_cast<int>(side);
+    const auto compressBlockSz = getCompressBlockSize();
+    const auto itemCnt = getCompressBlockItemCnt();
+    auto originSz = (int)std::min<i64>(compressBlockSz, getDataSize() - blockIdx * compressBlockSz);
+
+    /// grammar blocks are kept as they are in the cache, their items are decoded when probing
+    auto keepEncoded = false;
+    i64 blockOffset = 0;
+    int compDataSz = originSz;
+    auto iscompressed = false;
+    i64 seekpos = header->headerSize();
+
+    if (isCompressed()) {
+        iscompressed = getCompressedBlockInfo(blockIdx, side, blockOffset, compDataSz);
+        seekpos = getCompressedDataOffset(side) + blockOffset;
+        keepEncoded = iscompressed && getCodec(side) == EgtbCodec::grammar && compDataSz <= compressBlockSz;
+    } else {
+        seekpos += blockIdx * compressBlockSz;
+    }
+
+    auto block = std::make_shared<EgtbBlock>(keepEncoded ? compDataSz : compressBlockSz);
+    block->encoded = keepEncoded;
+    block->startIdx = blockIdx * itemCnt;
+    block->endIdx = std::min<i64>(block->startIdx + itemCnt, getSize());
+    assert(block->startIdx < block->endIdx);
+
+    auto r = false;
+    i64 decompressTime = 0;
+    if (keepEncoded) {
+        if (mapData[sd]) {
+            memcpy(block->data, mapData[sd] + seekpos, compDataSz);
+            r = true;
+        } else {
+            r = egtbFileHandleCache.read(getPath(side), seekpos, block->data, compDataSz);
+        }
+    } else if (mapData[sd]) {
+        auto src = mapData[sd] + seekpos;
+        auto startTime = egtbStats ? EgtbStats::now() : 0;
+        r = decompressBlock(side, src, compDataSz, iscompressed, block->data, originSz) == originSz;
+        decompressTime = egtbStats ? EgtbStats::now() - startTime : 0;
+    } else if (!iscompressed) {
+        r = compDataSz == originSz && egtbFileHandleCache.read(getPath(side), seekpos, block->data, originSz);
+    } else if (compDataSz <= compressBlockSz) {
+        /// buffer for compressed data, one per thread
+        static thread_local std::vector<char> compBuf;
+        if ((int)compBuf.size() < compressBlockSz) {
+            compBuf.resize(compressBlockSz);
+        }
+
+        if (egtbFileHandleCache.read(getPath(side), seekpos, compBuf.data(), compDataSz)) {
+            auto startTime = egtbStats ? EgtbStats::now() : 0;
+            r = decompressBlock(side, compBuf.data(), compDataSz, iscompressed, block->data, originSz) == originSz;
+            decompressTime = egtbStats ? EgtbStats::now() - startTime : 0;
+        }
+    }
+
+    if (r && egtbStats) {
+        if (!mapData[sd]) {
+            stats.add(side, EgtbStats::bytesRead, compDataSz);
+        }
+        if (iscompressed && !keepEncoded) {
+            stats.add(side, EgtbStats::blocksDecompressed);
+            stats.add(side, EgtbStats::decompressNs, decompressTime);
+        }
+    }
+
+    if (!r) {
+        if (egtbVerbose) {
+            std::cerr << "Error: cannot read block " << blockIdx << " of " << getPath(side) << std::endl;
+        }
+        return nullptr;
+    }
+    return block;
+}
+
+/// Read n bytes of the decompressed data of a block, from an offset (in bytes)
+bool EgtbFile::readBlockData(const EgtbBlock& block, int offset, int n, char* out, Side side) const
+{
+    if (!block.encoded) {
+        memcpy(out, block.data + offset, n);
         return true;
     }
 
-    if (egtbVerbose) {
-        std::cerr << "Error: cannot read " << getPath(side) << std::endl;
+    auto grammar = grammars[static_cast<int>(side)];
+    return grammar && grammar->decodeRange(block.data, block.size, offset, n, out);
+}
+
+int EgtbFile::getItemScore(const EgtbBlock& block, i64 k, Side side)
+{
+    if (!block.encoded) {
+        return getItemScore(block.data, k);
     }
-    return false;
+
+    alignas(2) char buf[2];
+    if (isWDL()) {
+        if (!readBlockData(block, (int)(k >> 2), 1, buf, side)) {
+            return EGTB_SCORE_MISSING;
+        }
+        return getItemScore(buf, k & 3);
+    }
+    if (isTwoBytes()) {
+        if (!readBlockData(block, (int)(k + k), 2, buf, side)) {
+            return TB_UNSET;
+        }
+        return getItemScore(buf, 0);
+    }
+    if (!readBlockData(block, (int)k, 1, buf, side)) {
+        return cellToScore(TB_MISSING);
+    }
+    return getItemScore(buf, 0);
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -512,14 +1031,39 @@ bool EgtbFile::readCompressedBlock(std::ifstream& file, i64 idx, Side side, char
 
 char EgtbFile::getCell(i64 idx, Side side)
 {
-    if (idx >= getSize() ||
-        (!isDataReady(idx, side) && !readBuf(idx, side))) {
+    if (idx >= getSize()) {
         return TB_MISSING;
     }
 
+    if (isUsingBlockCache()) {
+        auto block = getBlock(idx, side);
+        char cell;
+        if (!block || !readBlockData(*block, (int)(idx - block->startIdx), 1, &cell, side)) {
+            return TB_MISSING;
+        }
+        return cell;
+    }
+
+    if (!isDataReady(idx, side) && !readBuf(side)) {
+        return TB_MISSING;
+    }
+
+    return *getDataPointer(idx, side);
+}
+
+/// The data must be ready
+const char* EgtbFile::getDataPointer(i64 idx, Side side) const
+{
     auto sd = static_cast<int>(side);
-    char ch = pBuf[sd][idx - startpos[sd]];
-    return ch;
+    if (memMode == EgtbMemMode::mmap && !isCompressed()) {
+        auto offset = isWDL() ? idx >> 2 : isTwoBytes() ? idx + idx : idx;
+        return mapData[sd] + header->headerSize() + offset;
+    }
+
+    auto k = idx - startpos[sd];
+    if (isWDL()) k >>= 2;
+    else if (isTwoBytes()) k += k;
+    return pBuf[sd] + k;
 }
 
 int EgtbFile::getScore(const EgtbBoard& board, Side side, bool useLock)
@@ -542,22 +1086,44 @@ int EgtbFile::getScoreNoLock(const EgtbBoard& board, Side side) {
 
 int EgtbFile::getScoreNoLock(i64 idx, Side side)
 {
+    if (isWDL()) {
+        if (idx >= getSize()) {
+            return EGTB_SCORE_MISSING;
+        }
+
+        if (isUsingBlockCache()) {
+            auto block = getBlock(idx, side);
+            return block ? getItemScore(*block, idx - block->startIdx, side) : EGTB_SCORE_MISSING;
+        }
+
+        if (!isDataReady(idx, side) && !readBuf(side)) {
+            return EGTB_SCORE_MISSING;
+        }
+        /// the pointer is to the byte of the item
+        return getItemScore(getDataPointer(idx, side), idx & 3);
+    }
+
     if (isTwoBytes()) {
         if (idx >= getSize()) {
             return TB_UNSET;
         }
-        
-        int sd = static_cast<int>(side);
+
+        if (isUsingBlockCache()) {
+            auto block = getBlock(idx, side);
+            if (!block) {
+                return TB_UNSET;
+            }
+            return getItemScore(*block, idx - block->startIdx, side);
+        }
         
         if (!isDataReady(idx, side)) {
-            if (!readBuf(idx, side)) {
+            if (!readBuf(side)) {
                 return TB_UNSET;
             }
         }
         
-        assert(idx >= startpos[sd] && idx < endpos[sd]);
-        const i16 * p = (const i16 * )pBuf[sd];
-        i16 score = p[idx - startpos[sd]];
+        assert(isDataReady(idx, side));
+        i16 score = *(const i16*)getDataPointer(idx, side);
         return score;
     }
     
@@ -567,24 +1133,118 @@ int EgtbFile::getScoreNoLock(i64 idx, Side side)
 
 int EgtbFile::getScore(i64 idx, Side side, bool useLock)
 {
+    if (egtbStats) {
+        stats.add(side, EgtbStats::probes);
+    }
+
+    EgtbFilePinGuard pinGuard(this);
+
     checkToLoadHeaderAndTables(Side::none); // load all sides
     if (loadStatus == EgtbLoadStatus::error) {
         return EGTB_SCORE_MISSING;
     }
     assert(isValidHeader());
-    if (useLock && !isDataReady(idx, side)) {
-        std::lock_guard<std::mutex> thelock(sdmtx[static_cast<int>(side)]);
-        return getScoreNoLock(idx, side);
+
+    /// blocks from the cache and mapped data are immutable, they need no lock.
+    /// Data of all mode is loaded once under the lock, then read freely
+    if (useLock && !isUsingBlockCache() && memMode != EgtbMemMode::mmap) {
+        auto sd = static_cast<int>(side);
+        if (!dataLoaded[sd].load(std::memory_order_acquire)) {
+            auto startTime = egtbStats ? EgtbStats::now() : 0;
+            std::lock_guard<std::mutex> thelock(sdmtx[sd]);
+            if (egtbStats) {
+                stats.add(side, EgtbStats::lockWaitNs, EgtbStats::now() - startTime);
+            }
+            auto score = getScoreNoLock(idx, side);
+            if (memMode == EgtbMemMode::all && isDataReady(idx, side)) {
+                dataLoaded[sd].store(true, std::memory_order_release);
+            }
+            return score;
+        }
     }
     return getScoreNoLock(idx, side);
 }
 
 
+bool EgtbFile::isProbeReady(i64 idx, Side side)
+{
+    /// may be evicted by the memory budget
+    if (loadStatus.load(std::memory_order_acquire) != EgtbLoadStatus::loaded) {
+        return false;
+    }
+    if (idx < 0 || idx >= getSize()) {
+        return true;
+    }
+
+    if (isUsingBlockCache()) {
+        auto blockIdx = idx / getCompressBlockItemCnt();
+        return egtbBlockCache.find(EgtbBlockCache::createKey(fileId, side, blockIdx)) != nullptr;
+    }
+
+    /// pages of mapped files can't be checked cheaply, touching them is left to prefetching
+    if (memMode == EgtbMemMode::mmap) {
+        return false;
+    }
+    return dataLoaded[static_cast<int>(side)].load(std::memory_order_acquire);
+}
+
+void EgtbFile::getScores(const std::vector<i64>& idxVec, Side side, std::vector<int>& scores)
+{
+    scores.resize(idxVec.size());
+    getScores(idxVec.data(), (int)idxVec.size(), side, scores.data());
+}
+
+void EgtbFile::getScores(const i64* idxs, int cnt, Side side, int* scores)
+{
+    if (egtbStats && isUsingBlockCache()) {
+        stats.add(side, EgtbStats::probes, cnt);
+    }
+
+    EgtbFilePinGuard pinGuard(this);
+
+    checkToLoadHeaderAndTables(Side::none);
+    if (loadStatus == EgtbLoadStatus::error) {
+        std::fill(scores, scores + cnt, EGTB_SCORE_MISSING);
+        return;
+    }
+
+    if (!isUsingBlockCache()) {
+        for (auto i = 0; i < cnt; i++) {
+            scores[i] = getScore(idxs[i], side);
+        }
+        return;
+    }
+
+    /// visit indexes in order, thus all ones of a block come together
+    std::vector<int> order(cnt);
+    for (auto i = 0; i < cnt; i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [idxs](int a, int b) { return idxs[a] < idxs[b]; });
+
+    EgtbBlockPtr block;
+    for (auto && k : order) {
+        auto idx = idxs[k];
+        auto missingScore = isWDL() ? EGTB_SCORE_MISSING : isTwoBytes() ? TB_UNSET : cellToScore(TB_MISSING);
+        if (idx < 0 || idx >= getSize()) {
+            scores[k] = missingScore;
+            continue;
+        }
+
+        if (!block || idx >= block->endIdx) {
+            block = getBlock(idx, side);
+        }
+
+        scores[k] = block ? getItemScore(*block, idx - block->startIdx, side) : missingScore;
+    }
+}
+
 ////////////////////////////////////////////////////////////////////
 
 i64 EgtbFile::setupIdxComputing(const std::string& name, int order)
 {
     egtbName = name;
+    materialsign = computeMaterialSign(name);
     size = parseAttr(name, egtbIdxArray, (int*)pieceCount, order);
 
     attackerCount = 0;
@@ -600,6 +1260,38 @@ i64 EgtbFile::setupIdxComputing(const std::string& name, int order)
     return size;
 }
 
+u64 EgtbFile::computeMaterialSign(const std::string& name)
+{
+    u64 sign = 0;
+    auto sd = -1;
+    for (auto && ch : name) {
+        auto t = static_cast<int>(Funcs::charactorToPieceType(ch));
+        if (t == KING) {
+            sd++;
+        }
+        if (t == EMPTY || sd < 0 || sd > 1) {
+            return 0;
+        }
+        sign += u64(1) << (sd * 32 + t * 4);
+    }
+    return sd == 1 ? sign : 0;
+}
+
+u64 EgtbFile::computeMaterialSign(const BoardCore& board)
+{
+    u64 sign = 0;
+    for (auto sd = 0; sd < 2; sd++) {
+        for (auto i = 0; i < 16; i++) {
+            auto pos = board.pieceList[sd][i];
+            if (pos >= 0) {
+                auto t = static_cast<int>(board.getPiece(pos).type);
+                sign += u64(1) << (sd * 32 + t * 4);
+            }
+        }
+    }
+    return sign;
+}
+
 u64 EgtbFile::computeSize(const std::string &name)
 {
     EgtbIdxRecord egtbIdxRecord[16];
@@ -656,6 +1348,19 @@ int EgtbFile::_cellToScore(char cell) {
     }
 }
 
+int EgtbFile::wdlCellToScore(int cell) {
+    switch (cell) {
+        case TB_WDL_DRAW:
+            return EGTB_WDL_DRAW;
+        case TB_WDL_WIN:
+            return EGTB_WDL_WIN;
+        case TB_WDL_LOSS:
+            return EGTB_WDL_LOSS;
+        default:
+            return EGTB_SCORE_ILLEGAL;
+    }
+}
+
 int EgtbFile::verifyAKey(EgtbBoard& board, i64 idx) const
 {
     /// It is considered OK if it cann't setup the board
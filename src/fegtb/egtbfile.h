@@ -21,12 +21,17 @@
 #include <assert.h>
 #include <fstream>
 #include <mutex>
+#include <atomic>
 
 #include "egtb.h"
+#include "egtbcache.h"
+#include "egtbstats.h"
 
 
 namespace fegtb {
 
+class EgtbGrammar;
+
 const int EGTB_HEADER_SIZE                  = 128;
 const int EGTB_ID_MAIN                      = 556682;
 
@@ -41,9 +46,36 @@ const int EGTB_PROP_LARGE_COMPRESSTABLE_W   = (1 << 5);
 
 const int EGTB_PROP_COMPRESS_OPTIMIZED      = (1 << 8);
 const int EGTB_PROP_NEW                     = (1 << 9);
+const int EGTB_PROP_WDL                     = (1 << 10);
+
+const int EGTB_PROP_2LEVEL_COMPRESSTABLE_B  = (1 << 11);
+const int EGTB_PROP_2LEVEL_COMPRESSTABLE_W  = (1 << 12);
+
+/// blocks of that side are compressed by the lz codec instead of lzma
+const int EGTB_PROP_CODEC_LZ_B              = (1 << 13);
+const int EGTB_PROP_CODEC_LZ_W              = (1 << 14);
+
+/// a dictionary (4-byte size then its data) follows the compress table of that side,
+/// it primes the lz codec for every block
+const int EGTB_PROP_DICT_B                  = (1 << 15);
+const int EGTB_PROP_DICT_W                  = (1 << 16);
+
+/// blocks of that side are coded by a grammar, stored in place of the dictionary
+const int EGTB_PROP_CODEC_GRAMMAR_B         = (1 << 17);
+const int EGTB_PROP_CODEC_GRAMMAR_W         = (1 << 18);
+const int EGTB_GRAMMAR_MAX_SIZE             = 64 * 1024;
+
+/// Two-level compress tables: an absolute offset (8 bytes) of each group of blocks, followed by
+/// sizes (2 bytes) of all blocks. The top bit of a size marks an uncompressed block
+const int EGTB_2LEVEL_GROUP_BLOCKS          = 32;
+const int EGTB_2LEVEL_UNCOMPRESS_BIT        = 1 << 15;
+const int EGTB_2LEVEL_MAX_BLOCK_SIZE        = EGTB_2LEVEL_UNCOMPRESS_BIT - 1;
 
 
 const int EGTB_SIZE_COMPRESS_BLOCK          = 4 * 1024;
+/// block sizes stored in headers, from 1 KB to 64 KB
+const int EGTB_MIN_COMPRESS_BLOCK_LOG       = 10;
+const int EGTB_MAX_COMPRESS_BLOCK_LOG       = 16;
 const int EGTB_SMART_MODE_THRESHOLD         = 120L * 1024 * 1024L;
 
 
@@ -63,7 +95,7 @@ private:
     u32         signature;
     u32         property;
     u8          dtm_max;
-    u8          notused0;
+    u8          compressBlockSizeLog; // 0 for EGTB_SIZE_COMPRESS_BLOCK
     u8          notused[12];
 
     u16         order;
@@ -91,7 +123,10 @@ public:
         return isValid();
     }
 
-    bool isValid() const { return signature == EGTB_ID_MAIN; }
+    bool isValid() const {
+        return signature == EGTB_ID_MAIN
+            && (compressBlockSizeLog == 0 || (compressBlockSizeLog >= EGTB_MIN_COMPRESS_BLOCK_LOG && compressBlockSizeLog <= EGTB_MAX_COMPRESS_BLOCK_LOG));
+    }
 
     bool isSide(bslib::Side side) const {
         auto bit = side == bslib::Side::black ? EGTB_PROP_SIDE_BLACK : EGTB_PROP_SIDE_WHITE;
@@ -123,6 +158,19 @@ public:
     int getDtm_max() const { return dtm_max; }
     void setDtm_max(int m) { dtm_max = m; }
 
+    int getCompressBlockSize() const {
+        return compressBlockSizeLog ? 1 << compressBlockSizeLog : EGTB_SIZE_COMPRESS_BLOCK;
+    }
+    /// sz must be a power of two in the allowed range, 0 for the default one
+    void setCompressBlockSize(int sz) {
+        compressBlockSizeLog = 0;
+        if (sz && sz != EGTB_SIZE_COMPRESS_BLOCK) {
+            while ((1 << compressBlockSizeLog) < sz) {
+                compressBlockSizeLog++;
+            }
+        }
+    }
+
 #ifdef _WIN32
     void setName(const std::string& s)
     {
@@ -167,15 +215,20 @@ public:
     static u64 computeSize(const std::string &name);
     
     virtual int getCompressBlockSize() const {
-        return EGTB_SIZE_COMPRESS_BLOCK;
+        return header ? header->getCompressBlockSize() : EGTB_SIZE_COMPRESS_BLOCK;
     }
 
     virtual int getCompresseBlockCount() const {
-        auto sz = getSize();
-        if (isTwoBytes()) sz += sz;
+        auto sz = getDataSize();
         return (int)((sz + getCompressBlockSize() - 1) / getCompressBlockSize());
     }
 
+    /// number of items (not bytes) stored in a compress block
+    int getCompressBlockItemCnt() const {
+        if (isWDL()) return getCompressBlockSize() * 4;
+        return isTwoBytes() ? getCompressBlockSize() / 2 : getCompressBlockSize();
+    }
+
     bool    isCompressed() const { return header->getProperty() & EGTB_PROP_COMPRESSED; }
 
     i64     setupIdxComputing(const std::string& name, int order);
@@ -185,8 +238,15 @@ public:
     EgtbFileHeader* getHeader() { return  header; }
     const EgtbFileHeader* getHeader() const { return  header; }
     bool isBothArmed() const { return bothArmed; }
-    u32 getMaterialsign() const { return materialsign; }
+    u64 getMaterialsign() const { return materialsign; }
+    u32 getFileId() const { return fileId; }
     
+    /// Material signatures, 4 bits (piece count) per piece type, 32 bits per side.
+    /// For names, the left side is stored in the low bits; for boards, white is
+    static u64 computeMaterialSign(const std::string& name);
+    static u64 computeMaterialSign(const bslib::BoardCore& board);
+    static u64 flipMaterialSign(u64 sign) { return (sign >> 32) | (sign << 32); }
+
     static u64 parseAttr(const std::string& name, EgtbIdxRecord* egtbIdxRecordArray, int* pieceCount, u16 order);
 
 
@@ -197,6 +257,31 @@ public:
 
     int     getScore(i64 idx, bslib::Side side, bool useLock = true);
     int     getScore(const EgtbBoard& board, bslib::Side side, bool useLock = true);
+
+    /// Scores of many indexes of the same side. Indexes in the same block are answered
+    /// by decompressing that block once
+    void    getScores(const i64* idxs, int cnt, bslib::Side side, int* scores);
+    void    getScores(const std::vector<i64>& idxVec, bslib::Side side, std::vector<int>& scores);
+
+    /// True if probing the index needs no file reading or decompressing. Headers must be loaded
+    bool    isProbeReady(i64 idx, bslib::Side side);
+
+    /// counters, collected when egtbStats is true
+    const EgtbStats& getStats() const { return stats; }
+    void    resetStats() { stats.reset(); }
+
+    /// Memory of data buffers and compress tables is charged to the budget (nullptr for none)
+    void    setMemBudget(EgtbMemBudget* budget);
+    i64     getMemoryUsage() const;
+    u64     getLastAccess() const { return lastAccess.load(std::memory_order_relaxed); }
+
+    /// Probes pin the file, a pinned one can't be evicted. Return false if there is no budget
+    bool    pin();
+    void    unpin();
+
+    /// Release data and compress tables, back to header-only state. Fail if the file is busy.
+    /// Called by the memory budget under its lock, it doesn't call back into the budget
+    bool    evict();
     
     bool    preload(const std::string& _path, EgtbMemMode memMode, EgtbLoadMode loadMode);
     bool    loadHeaderAndTable(const std::string& path);
@@ -207,6 +292,9 @@ public:
     static int _cellToScore(char cell);
     bool    isDataReady(i64 pos, bslib::Side side) const {
         int sd = static_cast<int>(side);
+        if (memMode == EgtbMemMode::mmap && !isCompressed()) {
+            return mapData[sd] != nullptr;
+        }
         return pos >= startpos[sd] && pos < endpos[sd] && pBuf[sd]; }
 
     bool setupBoard(EgtbBoard& board, i64 idx, bslib::FlipMode flip, bslib::Side firstSide) const;
@@ -225,6 +313,28 @@ public:
         return (header->getProperty() & EGTB_PROP_2BYTES) != 0;
     }
 
+    /// WDL tables store 2 bits per item, their scores are EGTB_WDL_WIN, EGTB_WDL_DRAW, EGTB_WDL_LOSS
+    bool isWDL() const {
+        return (header->getProperty() & EGTB_PROP_WDL) != 0;
+    }
+
+    /// size in bytes of the (uncompressed) data of a side
+    i64 getDataSize() const {
+        auto sz = getSize();
+        if (isWDL()) return (sz + 3) / 4;
+        return isTwoBytes() ? sz + sz : sz;
+    }
+
+    static int wdlCellToScore(int cell);
+
+    /// DTM score to EGTB_WDL_WIN, EGTB_WDL_DRAW or EGTB_WDL_LOSS, other values are kept
+    static int scoreToWDL(int score) {
+        if (score == EGTB_SCORE_DRAW || abs(score) > EGTB_SCORE_MATE) {
+            return score;
+        }
+        return score > 0 ? EGTB_WDL_WIN : EGTB_WDL_LOSS;
+    }
+
     bool verifyKeys(bool printRandom = false) const;
     
 #define Verify_bit_setupOK  1
@@ -235,7 +345,7 @@ public:
 protected:
     EgtbFileHeader  *header = nullptr;
     bool            bothArmed;
-    u32             materialsign;
+    u64             materialsign;
     i64             size;
     i64             startpos[2], endpos[2];
     std::mutex      mtx, sdmtx[2];
@@ -243,20 +353,42 @@ protected:
     int             attackerCount;
     char*           pBuf[2];
     u8*             compressBlockTables[2];
-    char*           pCompressBuf;
+    char*           compressDicts[2];
+    int             compressDictSizes[2];
+    EgtbGrammar*    grammars[2];
+    std::atomic<u64> sharedIds[2];
+
+    /// for mmap mode
+    char*           mapData[2];
+    i64             mapSize[2];
+    void*           mapHandle[2];
     
     
     std::string     path[2];
     std::string     lupath[2];
 
-    EgtbLoadStatus  loadStatus;
+    /// published after headers and tables are loaded, probes read them without locks
+    std::atomic<EgtbLoadStatus> loadStatus;
+    /// all mode: set once the whole data of a side is in pBuf
+    std::atomic<bool> dataLoaded[2];
     EgtbIdxRecord   egtbIdxArray[16];
     EgtbMemMode     memMode;
     EgtbLoadMode    loadMode;
     std::string     egtbName;
     EgtbType        egtbType;
 
+    /// unique id, used for keys of the block cache
+    u32             fileId;
+
+    EgtbStats       stats;
+
+    EgtbMemBudget*  memBudget = nullptr;
+    std::atomic<int> pinCnt { 0 };
+    std::atomic<bool> evicting { false };
+    std::atomic<u64> lastAccess { 0 };
+
     void    reset();
+    void    chargeMemory();
 
     virtual bool readHeader(std::ifstream& file) {
         char buffer[200];
@@ -280,8 +412,43 @@ protected:
 
     virtual bool readCompressTable(std::ifstream& file, bslib::Side side);
     
+    bool isLargeCompressTable(bslib::Side side) const {
+        auto sd = static_cast<int>(side);
+        return (header->getProperty() & (EGTB_PROP_LARGE_COMPRESSTABLE_B << sd)) != 0;
+    }
+
+    bool isTwoLevelCompressTable(bslib::Side side) const {
+        auto sd = static_cast<int>(side);
+        return (header->getProperty() & (EGTB_PROP_2LEVEL_COMPRESSTABLE_B << sd)) != 0;
+    }
+
+    EgtbCodec getCodec(bslib::Side side) const {
+        auto sd = static_cast<int>(side);
+        auto property = header->getProperty();
+        if (property & (EGTB_PROP_CODEC_GRAMMAR_B << sd)) {
+            return EgtbCodec::grammar;
+        }
+        return (property & (EGTB_PROP_CODEC_LZ_B << sd)) != 0 ? EgtbCodec::lz : EgtbCodec::lzma;
+    }
+
+    bool hasCompressDict(bslib::Side side) const {
+        auto sd = static_cast<int>(side);
+        return (header->getProperty() & (EGTB_PROP_DICT_B << sd)) != 0;
+    }
+
+    /// position of the first compressed block in the file
+    i64 getCompressedDataOffset(bslib::Side side) const {
+        auto sd = static_cast<int>(side);
+        auto dictSectionSz = hasCompressDict(side) ? (i64)sizeof(u32) + compressDictSizes[sd] : 0;
+        return header->headerSize() + getBlockTableSize(side) + dictSectionSz;
+    }
+
     int getBlockTableSize(bslib::Side side) const {
         auto blockCnt = getCompresseBlockCount();
+        if (isTwoLevelCompressTable(side)) {
+            auto groupCnt = (blockCnt + EGTB_2LEVEL_GROUP_BLOCKS - 1) / EGTB_2LEVEL_GROUP_BLOCKS;
+            return groupCnt * (int)sizeof(i64) + blockCnt * (int)sizeof(u16);
+        }
         auto sd = static_cast<int>(side);
         int blockTableItemSize = (header->getProperty() & (EGTB_PROP_LARGE_COMPRESSTABLE_B << sd)) != 0 ? 5 : 4;
         int blockTableSz = blockCnt * blockTableItemSize; //sizeof(u32);
@@ -292,12 +459,13 @@ protected:
         return header && header->isValid();
     }
     
-    bool    readBuf(i64 startpos, bslib::Side side);
+    bool    readBuf(bslib::Side side);
 
     bool    createBuf(i64 len, bslib::Side side);
     i64     getBufItemCnt() const;
     i64     getBufSize() const {
         auto sz = getBufItemCnt();
+        if (isWDL()) return (sz + 3) / 4;
         if (isTwoBytes()) sz += sz;
         return sz;
     }
@@ -306,9 +474,38 @@ protected:
     int     getScoreNoLock(const EgtbBoard& board, bslib::Side side);
 
     char    getCell(i64 idx, bslib::Side side);
+    const char* getDataPointer(i64 idx, bslib::Side side) const;
+
+    /// score of the k-th item of a data buffer
+    int     getItemScore(const char* data, i64 k) {
+        if (isWDL()) {
+            return wdlCellToScore((data[k >> 2] >> ((k & 3) * 2)) & 3);
+        }
+        if (isTwoBytes()) {
+            return ((const i16*)data)[k];
+        }
+        return cellToScore(data[k]);
+    }
+    /// blocks of the block cache, they may be encoded
+    int     getItemScore(const EgtbBlock& block, i64 k, bslib::Side side);
+    bool    readBlockData(const EgtbBlock& block, int offset, int n, char* out, bslib::Side side) const;
 
     bool    loadAllData(std::ifstream& file, bslib::Side side);
-    bool    readCompressedBlock(std::ifstream& file, i64 idx, bslib::Side side, char* pDest);
+
+    /// tiny mode and compressed data in mmap mode are probed via the block cache
+    bool    isUsingBlockCache() const {
+        return memMode == EgtbMemMode::tiny || (memMode == EgtbMemMode::mmap && isCompressed());
+    }
+    EgtbBlockPtr getBlock(i64 idx, bslib::Side side);
+    /// id of the file of a side for the shared block cache, the same in all processes
+    u64     getSharedId(bslib::Side side);
+    EgtbBlockPtr loadBlock(i64 blockIdx, bslib::Side side);
+
+    bool    getCompressedBlockInfo(i64 blockIdx, bslib::Side side, i64& blockOffset, int& compDataSz) const;
+    int     decompressBlock(bslib::Side side, const char* src, int compDataSz, bool iscompressed, char* pDest, int originSz) const;
+
+    bool    mapFileData(bslib::Side side);
+    void    unmapFileData();
     
 };
 
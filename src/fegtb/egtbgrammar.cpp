@@ -0,0 +1,252 @@
+/**
+ This file is part of Felicity Egtb, distributed under MIT license.
+
+ * Copyright (c) 2024 Nguyen Hong Pham (github@nguyenpham)
+ * Copyright (c) 2024 developers
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ */
+
+#include <algorithm>
+#include <string.h>
+
+#include "egtb.h"
+#include "egtbgrammar.h"
+
+using namespace fegtb;
+
+/// refills 8 bits at a time, zeros after the end of data
+class EgtbGrammar::BitReader {
+public:
+    BitReader(const char* src, int srcSz) : p((const u8*)src), end((const u8*)src + srcSz) {
+        refill();
+    }
+
+    void refill() {
+        while (bits <= 56) {
+            u64 b = 0;
+            if (p < end) {
+                b = *p++;
+            } else {
+                overrun += 8;
+            }
+            buf |= b << (56 - bits);
+            bits += 8;
+        }
+    }
+
+    u32 peek32() const { return (u32)(buf >> 32); }
+
+    void consume(int n) {
+        buf <<= n;
+        bits -= n;
+        if (bits <= 56) {
+            refill();
+        }
+    }
+
+    /// read all data and more than the longest code of zeros
+    bool isBroken() const { return overrun - bits > MaxCodeLength; }
+
+private:
+    const u8 *p, *end;
+    u64 buf = 0;
+    int bits = 0, overrun = 0;
+};
+
+bool EgtbGrammar::load(const char* data, int sz)
+{
+    auto p = (const u8*)data, end = p + sz;
+    auto readU16 = [&](int& v) {
+        if (end - p < 2) {
+            return false;
+        }
+        v = p[0] | (p[1] << 8);
+        p += 2;
+        return true;
+    };
+
+    int symbolCnt, roundCnt;
+    if (!readU16(symbolCnt) || !readU16(roundCnt) || symbolCnt < 256 || symbolCnt > MaxSymbolCnt) {
+        return false;
+    }
+
+    roundEnds.clear();
+    for (auto i = 0, last = 256; i < roundCnt; i++) {
+        int e;
+        if (!readU16(e) || e < last || e > symbolCnt) {
+            return false;
+        }
+        roundEnds.push_back(e);
+        last = e;
+    }
+
+    lefts.resize(symbolCnt - 256);
+    rights.resize(symbolCnt - 256);
+    symLens.assign(symbolCnt, 1);
+    for (auto sym = 256; sym < symbolCnt; sym++) {
+        int left, right;
+        /// pairs of older symbols only
+        if (!readU16(left) || !readU16(right) || left >= sym || right >= sym) {
+            return false;
+        }
+        lefts[sym - 256] = left;
+        rights[sym - 256] = right;
+        auto len = symLens[left] + symLens[right];
+        if (len > MaxSymbolLength) {
+            return false;
+        }
+        symLens[sym] = len;
+    }
+
+    if (end - p < symbolCnt) {
+        return false;
+    }
+    codeLens.assign(p, p + symbolCnt);
+
+    /// expansions of all symbols
+    expOffsets.resize(symbolCnt);
+    expansions.clear();
+    for (auto sym = 0; sym < symbolCnt; sym++) {
+        expOffsets[sym] = (u32)expansions.size();
+        if (sym < 256) {
+            expansions.push_back((u8)sym);
+        } else {
+            auto left = lefts[sym - 256], right = rights[sym - 256];
+            /// copy first, inserting from itself is not allowed
+            auto l = expOffsets[left], r = expOffsets[right];
+            expansions.resize(expansions.size() + symLens[sym]);
+            auto q = expansions.data() + expOffsets[sym];
+            memcpy(q, expansions.data() + l, symLens[left]);
+            memcpy(q + symLens[left], expansions.data() + r, symLens[right]);
+        }
+    }
+
+    /// canonical codes, ordered by lengths then symbols
+    int counts[MaxCodeLength + 1] = { 0 };
+    for (auto && len : codeLens) {
+        if (len > MaxCodeLength) {
+            return false;
+        }
+        counts[len]++;
+    }
+    counts[0] = 0;
+
+    sortedSyms.clear();
+    for (auto len = 1; len <= MaxCodeLength; len++) {
+        for (auto sym = 0; sym < symbolCnt; sym++) {
+            if (codeLens[sym] == len) {
+                sortedSyms.push_back((u16)sym);
+            }
+        }
+    }
+    if (sortedSyms.empty()) {
+        return false;
+    }
+
+    codes.assign(symbolCnt, 0);
+    u32 code = 0;
+    auto k = 0;
+    for (auto len = 1; len <= MaxCodeLength; len++) {
+        firstCodes[len] = code;
+        offsets[len] = k;
+        /// over-subscribed
+        if ((u64)code + counts[len] > (1ULL << len)) {
+            return false;
+        }
+        for (auto i = 0; i < counts[len]; i++, k++) {
+            codes[sortedSyms[k]] = code + i;
+        }
+        code += counts[len];
+        limits[len] = (u64)code << (32 - len);
+        code <<= 1;
+    }
+
+    lookup.assign(1 << LookupBits, 0);
+    for (auto && sym : sortedSyms) {
+        auto len = codeLens[sym];
+        if (len > LookupBits) {
+            break;
+        }
+        auto shift = LookupBits - len;
+        auto from = codes[sym] << shift;
+        for (u32 i = 0; i < (1u << shift); i++) {
+            lookup[from + i] = sym | (len << 16);
+        }
+    }
+    return true;
+}
+
+int EgtbGrammar::decodeSymbol(BitReader& reader) const
+{
+    auto v = reader.peek32();
+    auto item = lookup[v >> (32 - LookupBits)];
+    if (item) {
+        auto len = (int)(item >> 16);
+        reader.consume(len);
+        return (int)(item & 0xffff);
+    }
+
+    for (auto len = LookupBits + 1; len <= MaxCodeLength; len++) {
+        if (v < limits[len]) {
+            auto sym = sortedSyms[offsets[len] + ((v >> (32 - len)) - firstCodes[len])];
+            reader.consume(len);
+            return sym;
+        }
+    }
+    return -1;
+}
+
+int EgtbGrammar::decodeBlock(const char* src, int srcSz, char* dst, int dstSz) const
+{
+    BitReader reader(src, srcSz);
+    auto d = dst;
+    for (auto left = dstSz; left > 0; ) {
+        auto sym = decodeSymbol(reader);
+        if (sym < 0 || reader.isBroken()) {
+            return -1;
+        }
+        auto len = std::min<int>(symLens[sym], left);
+        memcpy(d, expansions.data() + expOffsets[sym], len);
+        d += len;
+        left -= len;
+    }
+    return dstSz;
+}
+
+bool EgtbGrammar::decodeRange(const char* src, int srcSz, int offset, int n, char* out) const
+{
+    BitReader reader(src, srcSz);
+    for (auto pos = 0; n > 0; ) {
+        auto sym = decodeSymbol(reader);
+        if (sym < 0 || reader.isBroken()) {
+            return false;
+        }
+
+        /// walk lengths only, until reaching the offset
+        auto len = symLens[sym];
+        if (pos + len > offset) {
+            auto k = offset - pos;
+            auto m = std::min(len - k, n);
+            memcpy(out, expansions.data() + expOffsets[sym] + k, m);
+            out += m; offset += m; n -= m;
+        }
+        pos += len;
+    }
+    return true;
+}
+
+i64 EgtbGrammar::getMemoryUsage() const
+{
+    return (i64)(lefts.size() + rights.size() + symLens.size() + sortedSyms.size()) * sizeof(u16)
+        + (i64)(expOffsets.size() + codes.size() + lookup.size()) * sizeof(u32)
+        + (i64)(expansions.size() + codeLens.size()) + sizeof(EgtbGrammar);
+}
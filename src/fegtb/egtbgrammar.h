@@ -0,0 +1,86 @@
+/**
+ This file is part of Felicity Egtb, distributed under MIT license.
+
+ * Copyright (c) 2024 Nguyen Hong Pham (github@nguyenpham)
+ * Copyright (c) 2024 developers
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ */
+
+#ifndef fegtb_grammar_h
+#define fegtb_grammar_h
+
+#include <vector>
+
+#include "egtb.h"
+
+namespace fegtb {
+
+/*
+ * Static pair-substitution grammar with canonical Huffman codes. Symbols 0 - 255 are bytes,
+ * any other symbol stands for a pair of older symbols. A block is a bit stream (most significant
+ * bit first) of symbol codes. Expansions of all symbols are kept, thus a byte at any offset of
+ * a block is found by walking the codes and adding their lengths, without decoding the whole block.
+ *
+ * Stored format: u16 symbol count, u16 round count, u16 symbol end of each round,
+ * a pair (u16 left, u16 right) for each non-byte symbol, u8 code length of each symbol
+ */
+class EgtbGrammar {
+public:
+    static const int MaxSymbolCnt = 4096;
+    static const int MaxSymbolLength = 256;
+    static const int MaxCodeLength = 20;
+
+    bool    load(const char* data, int sz);
+
+    /// whole block, return the size of data or -1 if failed
+    int     decodeBlock(const char* src, int srcSz, char* dst, int dstSz) const;
+    /// n bytes from offset of the decoded block
+    bool    decodeRange(const char* src, int srcSz, int offset, int n, char* out) const;
+
+    int     getSymbolCnt() const { return (int)codeLens.size(); }
+    int     getLeft(int sym) const { return lefts[sym - 256]; }
+    int     getRight(int sym) const { return rights[sym - 256]; }
+    int     getSymbolLength(int sym) const { return symLens[sym]; }
+    const std::vector<int>& getRoundEnds() const { return roundEnds; }
+
+    /// the code of a symbol, right-aligned
+    u32     getCode(int sym) const { return codes[sym]; }
+    int     getCodeLength(int sym) const { return codeLens[sym]; }
+
+    i64     getMemoryUsage() const;
+
+private:
+    static const int LookupBits = 10;
+
+    std::vector<u16> lefts, rights, symLens;
+    std::vector<u32> expOffsets;
+    std::vector<u8> expansions;
+    std::vector<int> roundEnds;
+
+    std::vector<u8> codeLens;
+    std::vector<u32> codes;
+
+    /// canonical decoding: left-justified (32 bits) limits of codes by lengths
+    u64     limits[MaxCodeLength + 1];
+    u32     firstCodes[MaxCodeLength + 1];
+    int     offsets[MaxCodeLength + 1];
+    std::vector<u16> sortedSyms;
+    /// symbol and code length for codes up to LookupBits
+    std::vector<u32> lookup;
+
+    class BitReader;
+    int     decodeSymbol(BitReader& reader) const;
+};
+
+} // namespace fegtb
+
+#endif /* fegtb_grammar_h */
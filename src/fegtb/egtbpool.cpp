@@ -0,0 +1,137 @@
+/**
+ This file is part of Felicity Egtb, distributed under MIT license.
+
+ * Copyright (c) 2024 Nguyen Hong Pham (github@nguyenpham)
+ * Copyright (c) 2024 developers
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ */
+
+
+#include "egtbpool.h"
+
+using namespace fegtb;
+
+EgtbThreadPool::~EgtbThreadPool()
+{
+    stop();
+}
+
+void EgtbThreadPool::setThreadCount(int n)
+{
+    stop();
+    std::lock_guard<std::mutex> thelock(mtx);
+    threadCnt = std::max(0, n);
+}
+
+bool EgtbThreadPool::submit(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> thelock(mtx);
+        if (threadCnt <= 0 || stopping || jobs.size() >= maxQueue) {
+            return false;
+        }
+
+        if (threads.empty()) {
+            for (auto i = 0; i < threadCnt; i++) {
+                threads.push_back(std::thread(&EgtbThreadPool::work, this));
+            }
+        }
+        jobs.push_back(std::move(job));
+    }
+    jobCv.notify_one();
+    return true;
+}
+
+void EgtbThreadPool::wait()
+{
+    std::unique_lock<std::mutex> thelock(mtx);
+    doneCv.wait(thelock, [this] { return jobs.empty() && runningCnt == 0; });
+}
+
+void EgtbThreadPool::run(int cnt, const std::function<void(int)>& job)
+{
+    class RunState {
+    public:
+        std::atomic<int> next, doneCnt;
+        std::mutex mtx;
+        std::condition_variable cv;
+    };
+
+    auto state = std::make_shared<RunState>();
+    state->next = 0; state->doneCnt = 0;
+
+    /// the job is alive until the last index is done, helpers hold the state only
+    auto loop = [state, cnt, &job]() {
+        for (int k; (k = state->next++) < cnt; ) {
+            job(k);
+            if (++state->doneCnt == cnt) {
+                std::lock_guard<std::mutex> thelock(state->mtx);
+                state->cv.notify_all();
+            }
+        }
+    };
+
+    auto helperCnt = std::min(cnt - 1, threadCnt);
+    for (auto i = 0; i < helperCnt; i++) {
+        if (!submit(loop)) {
+            break;
+        }
+    }
+
+    loop();
+
+    std::unique_lock<std::mutex> thelock(state->mtx);
+    state->cv.wait(thelock, [state, cnt] { return state->doneCnt == cnt; });
+}
+
+/// pending jobs are done before threads stop
+void EgtbThreadPool::stop()
+{
+    std::vector<std::thread> vec;
+    {
+        std::lock_guard<std::mutex> thelock(mtx);
+        stopping = true;
+        vec.swap(threads);
+    }
+    jobCv.notify_all();
+
+    for (auto && t : vec) {
+        t.join();
+    }
+
+    std::lock_guard<std::mutex> thelock(mtx);
+    stopping = false;
+}
+
+void EgtbThreadPool::work()
+{
+    std::unique_lock<std::mutex> thelock(mtx);
+    while (true) {
+        jobCv.wait(thelock, [this] { return stopping || !jobs.empty(); });
+        if (jobs.empty()) {
+            return; /// stopping
+        }
+
+        auto job = std::move(jobs.front());
+        jobs.pop_front();
+        runningCnt++;
+
+        thelock.unlock();
+        job();
+        thelock.lock();
+
+        runningCnt--;
+        if (jobs.empty() && runningCnt == 0) {
+            doneCv.notify_all();
+        }
+    }
+}
@@ -0,0 +1,74 @@
+/**
+ This file is part of Felicity Egtb, distributed under MIT license.
+
+ * Copyright (c) 2024 Nguyen Hong Pham (github@nguyenpham)
+ * Copyright (c) 2024 developers
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ */
+
+
+#ifndef fegtb_pool_h
+#define fegtb_pool_h
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fegtb {
+
+/*
+ * A small pool of worker threads for background jobs of the probe library.
+ * Threads are started with the first submitted job
+ */
+class EgtbThreadPool {
+public:
+    static const int DefaultMaxQueue = 4096;
+
+    EgtbThreadPool(int threadCnt = 1) : threadCnt(threadCnt) {}
+    ~EgtbThreadPool();
+
+    /// stop current threads, new ones are started by next submits
+    void setThreadCount(int n);
+    int getThreadCount() const { return threadCnt; }
+
+    /// return false if the job is not accepted (the queue is full or no threads)
+    bool submit(std::function<void()> job);
+
+    /// wait until all submitted jobs are done
+    void wait();
+
+    /// call job(0) ... job(cnt - 1) on the pool threads and the calling one, return when all are done
+    void run(int cnt, const std::function<void(int)>& job);
+
+    void stop();
+
+private:
+    void work();
+
+    std::mutex mtx;
+    std::condition_variable jobCv, doneCv;
+    std::deque<std::function<void()>> jobs;
+    std::vector<std::thread> threads;
+    int threadCnt, runningCnt = 0;
+    size_t maxQueue = DefaultMaxQueue;
+    bool stopping = false;
+};
+
+} // namespace fegtb
+
+#endif
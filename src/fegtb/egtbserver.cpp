@@ -0,0 +1,254 @@
+/**
+ This file is part of Felicity Egtb, distributed under MIT license.
+
+ * Copyright (c) 2024 Nguyen Hong Pham (github@nguyenpham)
+ * Copyright (c) 2024 developers
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ */
+
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#endif
+
+#include "egtbserver.h"
+#include "egtbbatch.h"
+
+using namespace fegtb;
+using namespace bslib;
+
+bool EgtbServer::readAll(int fd, void* buf, int sz)
+{
+    auto p = (char*)buf;
+    while (sz > 0) {
+#ifdef _WIN32
+        auto k = _read(fd, p, sz);
+#else
+        auto k = (int)::read(fd, p, sz);
+        if (k < 0 && errno == EINTR) {
+            continue;
+        }
+#endif
+        if (k <= 0) {
+            return false;
+        }
+        p += k; sz -= k;
+    }
+    return true;
+}
+
+bool EgtbServer::writeAll(int fd, const void* buf, int sz)
+{
+    auto p = (const char*)buf;
+    while (sz > 0) {
+#ifdef _WIN32
+        auto k = _write(fd, p, sz);
+#else
+        auto k = (int)::write(fd, p, sz);
+        if (k < 0 && errno == EINTR) {
+            continue;
+        }
+#endif
+        if (k <= 0) {
+            return false;
+        }
+        p += k; sz -= k;
+    }
+    return true;
+}
+
+/// Read a position, an invalid one is read completely thus the stream is still in sync
+bool EgtbServer::readPosition(int inFd, std::vector<u8>& buf, EgtbBoard& board, bool& valid)
+{
+    /// format, side and the size field
+    u8 head[4];
+    if (!readAll(inFd, head, 3)) {
+        return false;
+    }
+    auto headSz = static_cast<EgtbPositionFormat>(head[0]) == EgtbPositionFormat::fen ? 4 : 3;
+    if (headSz > 3 && !readAll(inFd, head + 3, 1)) {
+        return false;
+    }
+
+    /// unknown formats can't be skipped
+    auto sz = EgtbBatchProber::getPositionSize(head, headSz);
+    if (sz <= 0) {
+        return false;
+    }
+
+    buf.resize(sz);
+    memcpy(buf.data(), head, headSz);
+    if (sz > headSz && !readAll(inFd, buf.data() + headSz, sz - headSz)) {
+        return false;
+    }
+
+    valid = EgtbBatchProber::setupBoard(board, buf.data());
+    return true;
+}
+
+bool EgtbServer::serveConnection(int inFd, int outFd)
+{
+    std::vector<EgtbBoard> boards;
+    std::vector<int> boardIdxs, scores, probedScores;
+    std::vector<u8> buf;
+
+    while (true) {
+        u32 head[2];
+        if (!readAll(inFd, head, sizeof(head))) {
+            return true; /// closed by the client
+        }
+
+        auto cnt = (int)head[1];
+        if (head[0] != EGTB_SERVE_MAGIC || head[1] > (u32)MaxBatchSize) {
+            std::cerr << "Error: invalid request, connection closed" << std::endl;
+            return false;
+        }
+
+        /// valid boards only, with their indexes in the request. They grow with the positions
+        /// really received, not with the count claimed by the header
+        boardIdxs.clear();
+        scores.clear();
+        auto validCnt = 0;
+        for (auto i = 0; i < cnt; i++) {
+            if ((int)boards.size() <= validCnt) {
+                boards.resize(boards.size() * 2 + 64);
+            }
+            bool valid;
+            if (!readPosition(inFd, buf, boards[validCnt], valid)) {
+                std::cerr << "Error: invalid position in request, connection closed" << std::endl;
+                return false;
+            }
+            scores.push_back(EGTB_SCORE_MISSING);
+            if (valid) {
+                boardIdxs.push_back(i);
+                validCnt++;
+            }
+        }
+
+        if (validCnt > 0) {
+            probedScores.resize(validCnt);
+            egtbDb.getScores(boards.data(), validCnt, probedScores.data(), true);
+            for (auto i = 0; i < validCnt; i++) {
+                scores[boardIdxs[i]] = probedScores[i];
+            }
+        }
+
+        if (!writeAll(outFd, head, sizeof(head)) || (cnt > 0 && !writeAll(outFd, scores.data(), cnt * (int)sizeof(int)))) {
+            return false;
+        }
+    }
+}
+
+bool EgtbServer::serveStream(int inFd, int outFd)
+{
+#ifndef _WIN32
+    /// a client closing early is not an error of the server
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    return serveConnection(inFd, outFd);
+}
+
+/// Join finished connection threads, or all of them, waking up the ones blocked in reading
+void EgtbServer::reapConnections(bool all)
+{
+#ifndef _WIN32
+    for (auto it = connections.begin(); it != connections.end();) {
+        if (!all && !it->done) {
+            ++it;
+            continue;
+        }
+        if (!it->done) {
+            shutdown(it->fd, SHUT_RDWR);
+        }
+        it->thread.join();
+        close(it->fd);
+        it = connections.erase(it);
+    }
+#endif
+}
+
+bool EgtbServer::serveSocket(const std::string& path)
+{
+#ifdef _WIN32
+    std::cerr << "Error: unix domain sockets are not supported on this platform, use - for stdin/stdout" << std::endl;
+    return false;
+#else
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Error: socket path is too long " << path << std::endl;
+        return false;
+    }
+    strcpy(addr.sun_path, path.c_str());
+
+    auto listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        std::cerr << "Error: cannot create socket, " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    /// a socket file left by an old server
+    unlink(path.c_str());
+    if (bind(listenFd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd, 64) != 0) {
+        std::cerr << "Error: cannot listen on " << path << ", " << strerror(errno) << std::endl;
+        close(listenFd);
+        return false;
+    }
+
+    std::cerr << "Serving probes on " << path << std::endl;
+    signal(SIGPIPE, SIG_IGN);
+
+    while (true) {
+        auto fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            std::cerr << "Error: cannot accept connections, " << strerror(errno) << std::endl;
+            break;
+        }
+
+        reapConnections(false);
+        if ((int)connections.size() >= MaxConnections) {
+            close(fd);
+            continue;
+        }
+
+        /// the client sees the end at once, but the fd is closed by the accepting thread after joining,
+        /// thus it can't be reused meanwhile
+        connections.emplace_back();
+        auto& connection = connections.back();
+        connection.fd = fd;
+        connection.thread = std::thread([this, &connection]() {
+            serveConnection(connection.fd, connection.fd);
+            shutdown(connection.fd, SHUT_RDWR);
+            connection.done = true;
+        });
+    }
+
+    close(listenFd);
+    reapConnections(true);
+    return false;
+#endif
+}
@@ -0,0 +1,82 @@
+/**
+ This file is part of Felicity Egtb, distributed under MIT license.
+
+ * Copyright (c) 2024 Nguyen Hong Pham (github@nguyenpham)
+ * Copyright (c) 2024 developers
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ */
+
+
+#ifndef fegtb_server_h
+#define fegtb_server_h
+
+#include <atomic>
+#include <list>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "egtbdb.h"
+
+namespace fegtb {
+
+/*
+ * A probe server: it loads an EgtbDb once and answers batches of probes from other processes,
+ * which then share its caches and memory. Requests and responses are binary, little endian:
+ *
+ *   request:   u32 EGTB_SERVE_MAGIC, u32 count, then count positions
+ *   position:  u8 format, u8 side (0: black, 1: white, 2: side to move of the FEN), then
+ *              format 0 (FEN):     u16 length, the FEN string
+ *              format 1 (compact): u8 piece count, then pairs of u8 piece (type | side << 4), u8 square
+ *   response:  u32 EGTB_SERVE_MAGIC, u32 count, then count i32 scores
+ *
+ * Invalid positions get EGTB_SCORE_MISSING. A request of count 0 is a ping. Each connection has
+ * its own thread, batches are probed in parallel by the probe threads of the EgtbDb. The connection
+ * threads use the EgtbDb, serveSocket joins them all before returning
+ */
+const u32 EGTB_SERVE_MAGIC = 0x53474546; // "FEGS"
+
+class EgtbServer {
+public:
+    static const int MaxBatchSize = 1 << 16;
+    static const int MaxConnections = 256;
+
+    EgtbServer(EgtbDb& egtbDb) : egtbDb(egtbDb) {}
+
+    /// Listen on a unix domain socket, return only if failed, after closing all connections
+    bool serveSocket(const std::string& path);
+
+    /// Requests from inFd, responses to outFd (such as stdin and stdout) until the input ends
+    bool serveStream(int inFd, int outFd);
+
+private:
+    bool    serveConnection(int inFd, int outFd);
+    bool    readPosition(int inFd, std::vector<u8>& buf, EgtbBoard& board, bool& valid);
+    void    reapConnections(bool all);
+
+    static bool readAll(int fd, void* buf, int sz);
+    static bool writeAll(int fd, const void* buf, int sz);
+
+    struct Connection {
+        int fd = -1;
+        std::thread thread;
+        std::atomic<bool> done { false };
+    };
+
+    EgtbDb& egtbDb;
+    /// used by the accepting thread only, the connection threads just set their done flags
+    std::list<Connection> connections;
+};
+
+} // namespace fegtb
+
+#endif /* fegtb_server_h */
@@ -0,0 +1,74 @@
+/**
+ This file is part of Felicity Egtb, distributed under MIT license.
+
+ * Copyright (c) 2024 Nguyen Hong Pham (github@nguyenpham)
+ * Copyright (c) 2024 developers
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ */
+
+
+#include <sstream>
+
+#include "egtb.h"
+#include "egtbstats.h"
+
+using namespace fegtb;
+using namespace bslib;
+
+const char* EgtbStats::itemNames[EgtbStats::itemCount] = {
+    "probes",
+    "cacheHits",
+    "cacheMisses",
+    "blocksDecompressed",
+    "bytesRead",
+    "decompressNs",
+    "lockWaitNs",
+    "headerLoads",
+    "dataLoads",
+    "sharedCacheHits"
+};
+
+bool EgtbStats::isEmpty() const
+{
+    for (auto sd = 0; sd < 2; sd++) {
+        for (auto i = 0; i < itemCount; i++) {
+            if (values[sd][i].load(std::memory_order_relaxed)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void EgtbStats::reset()
+{
+    for (auto sd = 0; sd < 2; sd++) {
+        for (auto i = 0; i < itemCount; i++) {
+            values[sd][i] = 0;
+        }
+    }
+}
+
+std::string EgtbStats::toJson() const
+{
+    std::ostringstream stringStream;
+    stringStream << "{";
+    for (auto sd = 1; sd >= 0; sd--) {
+        stringStream << (sd == 1 ? "\"w\":{" : ",\"b\":{");
+        for (auto i = 0; i < itemCount; i++) {
+            stringStream << (i ? "," : "") << "\"" << itemNames[i] << "\":" << values[sd][i].load(std::memory_order_relaxed);
+        }
+        stringStream << "}";
+    }
+    stringStream << "}";
+    return stringStream.str();
+}
@@ -0,0 +1,79 @@
+/**
+ This file is part of Felicity Egtb, distributed under MIT license.
+
+ * Copyright (c) 2024 Nguyen Hong Pham (github@nguyenpham)
+ * Copyright (c) 2024 developers
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ */
+
+
+#ifndef fegtb_stats_h
+#define fegtb_stats_h
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include "egtb.h"
+
+namespace fegtb {
+
+/*
+ * Counters of a table, by sides. They are updated only when egtbStats is true
+ */
+class EgtbStats {
+public:
+    enum Item {
+        probes,
+        cacheHits,
+        cacheMisses,
+        blocksDecompressed,
+        bytesRead,
+        decompressNs,
+        lockWaitNs,
+        headerLoads,
+        dataLoads,
+        sharedCacheHits,
+        itemCount
+    };
+
+    static const char* itemNames[itemCount];
+
+    EgtbStats() {
+        reset();
+    }
+
+    void add(bslib::Side side, Item item, i64 value = 1) {
+        values[static_cast<int>(side)][item].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    i64 get(bslib::Side side, Item item) const {
+        return values[static_cast<int>(side)][item].load(std::memory_order_relaxed);
+    }
+
+    bool isEmpty() const;
+    void reset();
+
+    /// JSON object of both sides, such as {"w":{"probes":10,...},"b":{...}}
+    std::string toJson() const;
+
+    static i64 now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    std::atomic<i64> values[2][itemCount];
+};
+
+} // namespace fegtb
+
+#endif
@@ -16,6 +16,9 @@
  */
 
 #include <algorithm>
+#include <queue>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 #include <thread>
 #include <assert.h>
@@ -25,6 +28,9 @@
 #include "compresslib.h"
 #include "threadmng.h"
 
+#include "../fegtb/egtbfile.h"
+#include "../fegtb/egtbgrammar.h"
+
 #include "../lzma/7zTypes.h"
 #include "../lzma/LzmaDec.h"
 #include "../lzma/LzmaEnc.h"
@@ -102,24 +108,536 @@ int CompressLib::decompressLzma(char *dst, int uncompresslen, const char *src, i
 }
 
 
+/// Greedy LZ77 with hash chains, see egtb.h for the format. Encoding is not fast but that
+/// doesn't matter for generating, decoding is what probes pay for
+int CompressLib::compressLz(char *dest, const char *src, int slen, const char* dict, int dictLen) {
+    assert(dest && src && slen > 0 && dictLen >= 0 && dictLen <= EGTB_LZ_MAX_DICT_SIZE);
+
+    const int hashBits = 14, maxChainLen = 64, maxOffset = 0xffff;
+
+    /// the dictionary is data preceding the block
+    static thread_local std::vector<u8> buf;
+    static thread_local std::vector<int> head, chain;
+    auto total = dictLen + slen;
+    buf.resize(total);
+    if (dictLen) {
+        memcpy(buf.data(), dict, dictLen);
+    }
+    memcpy(buf.data() + dictLen, src, slen);
+
+    head.assign(1 << hashBits, -1);
+    if ((int)chain.size() < total) {
+        chain.resize(total);
+    }
+
+    auto s = buf.data();
+    auto d = (u8*)dest;
+
+    /// the last bytes are always literals
+    const int matchLimit = total - EGTB_LZ_MIN_MATCH - 1;
+
+    auto hashAt = [&](int pos) {
+        u32 v; memcpy(&v, s + pos, sizeof(v));
+        return (v * 2654435761U) >> (32 - hashBits);
+    };
+    auto insert = [&](int pos) {
+        auto h = hashAt(pos);
+        chain[pos] = head[h]; head[h] = pos;
+    };
+    auto writeLength = [&](int len) {
+        for(; len >= 255; len -= 255) {
+            *d++ = 255;
+        }
+        *d++ = (u8)len;
+    };
+    auto writeSequence = [&](int litStart, int litLen, int offset, int matchLen) {
+        auto m = matchLen - EGTB_LZ_MIN_MATCH;
+        *d++ = (u8)((std::min(litLen, 15) << 4) | (matchLen ? std::min(m, 15) : 0));
+        if (litLen >= 15) {
+            writeLength(litLen - 15);
+        }
+        memcpy(d, s + litStart, litLen);
+        d += litLen;
+        if (matchLen) {
+            *d++ = (u8)offset;
+            *d++ = (u8)(offset >> 8);
+            if (m >= 15) {
+                writeLength(m - 15);
+            }
+        }
+    };
+
+    for(auto pos = 0; pos < std::min(dictLen, matchLimit); pos++) {
+        insert(pos);
+    }
+
+    auto litStart = dictLen;
+    for(auto pos = dictLen; pos < matchLimit; ) {
+        auto bestLen = 0, bestOffset = 0;
+        auto maxLen = total - pos;
+        auto k = 0;
+        for(auto cand = head[hashAt(pos)]; cand >= 0 && pos - cand <= maxOffset && k < maxChainLen; cand = chain[cand], k++) {
+            if (s[cand + bestLen] != s[pos + bestLen]) {
+                continue;
+            }
+            auto len = 0;
+            while (len < maxLen && s[cand + len] == s[pos + len]) {
+                len++;
+            }
+            if (len > bestLen) {
+                bestLen = len; bestOffset = pos - cand;
+                if (len == maxLen) {
+                    break;
+                }
+            }
+        }
+
+        insert(pos);
+
+        if (bestLen < EGTB_LZ_MIN_MATCH) {
+            pos++;
+            continue;
+        }
+
+        writeSequence(litStart, pos - litStart, bestOffset, bestLen);
+
+        /// index the matched positions too
+        auto end = pos + bestLen;
+        for(pos++; pos < end && pos < matchLimit; pos++) {
+            insert(pos);
+        }
+        pos = end;
+        litStart = end;
+    }
+
+    writeSequence(litStart, total - litStart, 0, 0);
+
+    auto dlen = (int)(d - (u8*)dest);
+
+#ifdef TEST_DECOMPRESS
+    char *tmpBuf = (char*)malloc(slen + 64);
+    auto x = decompressLz(tmpBuf, slen, dest, dlen, dict, dictLen);
+    assert(x == slen && memcmp(tmpBuf, src, slen) == 0);
+    free(tmpBuf);
+#endif
+    return dlen;
+}
+
+/*
+ * Train a dictionary for the lz codec, a simplified COVER algorithm: segments of sample blocks
+ * are scored by how many samples share their 8-byte substrings (dmers). The best segments are
+ * picked greedily, dmers of a picked segment no longer count for others. The best segments are
+ * put at the end of the dictionary, closest to the data thus with the smallest offsets
+ */
+std::vector<char> CompressLib::trainDictionary(const char *src, i64 slen, int blocksize, int dictSize)
+{
+    assert(src && slen > 0 && blocksize > 0 && dictSize > 0 && dictSize <= EGTB_LZ_MAX_DICT_SIZE);
+    std::vector<char> dict;
+
+    const int dmerSz = 8, segmentSz = 64, segmentStep = 32, samplesPerDictByte = 32;
+
+    auto blocknum = (slen + blocksize - 1) / blocksize;
+    /// too small, blocks have nothing to share
+    if (blocknum < 4 || slen < (i64)dictSize * 2) {
+        return dict;
+    }
+
+    /// evenly spaced sample blocks
+    auto sampleCnt = std::min<i64>(blocknum, std::max<i64>(1, (i64)dictSize * samplesPerDictByte / blocksize));
+    std::vector<std::pair<const u8*, int>> samples;
+    for(i64 i = 0; i < sampleCnt; i++) {
+        auto b = i * blocknum / sampleCnt;
+        auto sz = (int)std::min<i64>(blocksize, slen - b * blocksize);
+        samples.push_back({ (const u8*)src + b * blocksize, sz });
+    }
+
+    auto dmerAt = [](const u8* p) {
+        u64 v; memcpy(&v, p, sizeof(v));
+        return v;
+    };
+
+    /// number of samples containing each dmer
+    struct DmerInfo {
+        int cnt = 0, lastSample = -1;
+    };
+    std::unordered_map<u64, DmerInfo> freqMap;
+    for(auto i = 0; i < (int)samples.size(); i++) {
+        auto& sample = samples[i];
+        for(auto j = 0; j + dmerSz <= sample.second; j++) {
+            auto& info = freqMap[dmerAt(sample.first + j)];
+            if (info.lastSample != i) {
+                info.lastSample = i;
+                info.cnt++;
+            }
+        }
+    }
+
+    std::vector<u64> dmers;
+    auto scoreOf = [&](const u8* seg, int segSz) {
+        dmers.clear();
+        for(auto j = 0; j + dmerSz <= segSz; j++) {
+            dmers.push_back(dmerAt(seg + j));
+        }
+        std::sort(dmers.begin(), dmers.end());
+        dmers.erase(std::unique(dmers.begin(), dmers.end()), dmers.end());
+
+        i64 score = 0;
+        for(auto && m : dmers) {
+            auto cnt = freqMap[m].cnt;
+            /// a dmer of one sample only is useless
+            score += cnt > 1 ? cnt : 0;
+        }
+        return score;
+    };
+
+    typedef std::tuple<i64, const u8*, int> Candidate; // score, segment, size
+    std::priority_queue<Candidate> queue;
+    for(auto && sample : samples) {
+        for(auto j = 0; j < sample.second; j += segmentStep) {
+            auto segSz = std::min(segmentSz, sample.second - j);
+            if (segSz >= dmerSz) {
+                queue.push({ scoreOf(sample.first + j, segSz), sample.first + j, segSz });
+            }
+        }
+    }
+
+    /// lazy greedy: scores only go down when segments are picked
+    std::vector<std::pair<const u8*, int>> picked;
+    auto pickedSz = 0;
+    while (!queue.empty() && pickedSz < dictSize) {
+        auto candidate = queue.top();
+        queue.pop();
+
+        auto seg = std::get<1>(candidate);
+        auto segSz = std::get<2>(candidate);
+        auto score = scoreOf(seg, segSz);
+        if (score <= 0) {
+            continue;
+        }
+        if (!queue.empty() && score < std::get<0>(queue.top())) {
+            queue.push({ score, seg, segSz });
+            continue;
+        }
+
+        picked.push_back({ seg, segSz });
+        pickedSz += segSz;
+        for(auto && m : dmers) {
+            freqMap[m].cnt = 0;
+        }
+    }
+
+    if (pickedSz < dictSize / 4) {
+        return dict;
+    }
+
+    for(auto it = picked.rbegin(); it != picked.rend(); ++it) {
+        dict.insert(dict.end(), (const char*)it->first, (const char*)it->first + it->second);
+    }
+    if ((int)dict.size() > dictSize) {
+        dict.erase(dict.begin(), dict.begin() + (dict.size() - dictSize));
+    }
+    return dict;
+}
+
+/*
+ * Grammar codec, see EgtbGrammar for the format. Rules are learnt from sample blocks: each round
+ * the most frequent pairs of adjacent symbols, which share no symbol with each other, become new
+ * symbols. Encoding replays the rounds on a block then writes Huffman codes of the symbols left
+ */
+std::vector<char> CompressLib::trainGrammar(const char *src, i64 slen, int blocksize)
+{
+    assert(src && slen > 0 && blocksize > 0);
+
+    const i64 maxSampleSz = 2 * 1024 * 1024L;
+    const int pairsPerRound = 64, minPairCnt = 16;
+
+    /// evenly spaced sample blocks, as symbols
+    auto blocknum = (slen + blocksize - 1) / blocksize;
+    auto sampleCnt = std::max<i64>(1, std::min<i64>(blocknum, maxSampleSz / blocksize));
+    std::vector<std::vector<u16>> samples;
+    for(i64 i = 0; i < sampleCnt; i++) {
+        auto b = i * blocknum / sampleCnt;
+        auto sz = (int)std::min<i64>(blocksize, slen - b * blocksize);
+        auto p = (const u8*)src + b * blocksize;
+        samples.push_back(std::vector<u16>(p, p + sz));
+    }
+
+    std::vector<int> symLens(256, 1), roundEnds;
+    std::vector<std::pair<u16, u16>> pairs;
+    std::vector<u32> keys;
+
+    while ((int)symLens.size() < EgtbGrammar::MaxSymbolCnt) {
+        /// counts of pairs
+        keys.clear();
+        for(auto && sample : samples) {
+            for(size_t j = 1; j < sample.size(); j++) {
+                keys.push_back(u32(sample[j - 1]) << 16 | sample[j]);
+            }
+        }
+        std::sort(keys.begin(), keys.end());
+
+        std::vector<std::pair<int, u32>> candidates; // count, pair
+        for(size_t j = 0; j < keys.size(); ) {
+            auto k = j;
+            while (k < keys.size() && keys[k] == keys[j]) k++;
+            auto left = keys[j] >> 16, right = keys[j] & 0xffff;
+            if ((int)(k - j) >= minPairCnt && symLens[left] + symLens[right] <= EgtbGrammar::MaxSymbolLength) {
+                candidates.push_back({ (int)(k - j), keys[j] });
+            }
+            j = k;
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const std::pair<int, u32>& a, const std::pair<int, u32>& b) {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+
+        /// pairs of a round share no symbol, thus replacing them in any order gives the same result
+        std::unordered_map<u32, u16> roundMap;
+        std::vector<bool> used(symLens.size(), false);
+        for(auto && c : candidates) {
+            if ((int)roundMap.size() >= pairsPerRound || (int)symLens.size() >= EgtbGrammar::MaxSymbolCnt) {
+                break;
+            }
+            auto left = c.second >> 16, right = c.second & 0xffff;
+            if (used[left] || used[right]) {
+                continue;
+            }
+            used[left] = used[right] = true;
+            roundMap[c.second] = (u16)symLens.size();
+            pairs.push_back({ (u16)left, (u16)right });
+            symLens.push_back(symLens[left] + symLens[right]);
+        }
+
+        if (roundMap.empty()) {
+            break;
+        }
+        roundEnds.push_back((int)symLens.size());
+
+        for(auto && sample : samples) {
+            replaceGrammarPairs(sample, roundMap);
+        }
+    }
+
+    /// all symbols may appear in other blocks, none has a zero frequency
+    auto symbolCnt = (int)symLens.size();
+    std::vector<i64> freqs(symbolCnt, 1);
+    for(auto && sample : samples) {
+        for(auto && sym : sample) {
+            freqs[sym]++;
+        }
+    }
+
+    auto codeLens = createHuffmanCodeLengths(freqs, EgtbGrammar::MaxCodeLength);
+
+    std::vector<char> grammar;
+    auto writeU16 = [&](int v) {
+        grammar.push_back((char)(v & 0xff));
+        grammar.push_back((char)(v >> 8));
+    };
+    writeU16(symbolCnt);
+    writeU16((int)roundEnds.size());
+    for(auto && e : roundEnds) {
+        writeU16(e);
+    }
+    for(auto && p : pairs) {
+        writeU16(p.first);
+        writeU16(p.second);
+    }
+    for(auto && len : codeLens) {
+        grammar.push_back((char)len);
+    }
+    assert((int)grammar.size() <= EGTB_GRAMMAR_MAX_SIZE);
+    return grammar;
+}
+
+/// Replace pairs of a round, from left to right
+void CompressLib::replaceGrammarPairs(std::vector<u16>& symbols, const std::unordered_map<u32, u16>& roundMap)
+{
+    size_t k = 0;
+    for(size_t j = 0; j < symbols.size(); ) {
+        if (j + 1 < symbols.size()) {
+            auto it = roundMap.find(u32(symbols[j]) << 16 | symbols[j + 1]);
+            if (it != roundMap.end()) {
+                symbols[k++] = it->second;
+                j += 2;
+                continue;
+            }
+        }
+        symbols[k++] = symbols[j++];
+    }
+    symbols.resize(k);
+}
+
+/// Lengths of Huffman codes, frequencies are flattened until no code is longer than maxLen
+std::vector<u8> CompressLib::createHuffmanCodeLengths(std::vector<i64> freqs, int maxLen)
+{
+    auto n = (int)freqs.size();
+    assert(n >= 2 && n <= (1 << maxLen));
+    std::vector<u8> lens(n);
+
+    while (true) {
+        /// nodes 0 - n-1 are leaves, others are internal nodes
+        std::vector<int> parents(n * 2, -1);
+        typedef std::pair<i64, int> Node; // frequency, node
+        std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+        for(auto i = 0; i < n; i++) {
+            queue.push({ freqs[i], i });
+        }
+
+        auto nodeCnt = n;
+        while (queue.size() > 1) {
+            auto a = queue.top(); queue.pop();
+            auto b = queue.top(); queue.pop();
+            parents[a.second] = parents[b.second] = nodeCnt;
+            queue.push({ a.first + b.first, nodeCnt++ });
+        }
+
+        /// parents are created after their children, depths are computed from the root down
+        std::vector<int> depths(nodeCnt, 0);
+        for(auto i = nodeCnt - 2; i >= 0; i--) {
+            depths[i] = depths[parents[i]] + 1;
+        }
+
+        auto maxDepth = 0;
+        for(auto i = 0; i < n; i++) {
+            lens[i] = (u8)std::min(depths[i], 255);
+            maxDepth = std::max(maxDepth, depths[i]);
+        }
+        if (maxDepth <= maxLen) {
+            return lens;
+        }
+
+        for(auto && f : freqs) {
+            f = (f + 1) / 2;
+        }
+    }
+}
+
+struct CompressLib::GrammarCodecData {
+    std::vector<char> data;
+    EgtbGrammar grammar;
+    std::vector<std::unordered_map<u32, u16>> roundMaps;
+};
+
+bool CompressLib::loadGrammarCodecData(GrammarCodecData& codecData, const std::vector<char>& data)
+{
+    codecData.data = data;
+    codecData.roundMaps.clear();
+    if (!codecData.grammar.load(data.data(), (int)data.size())) {
+        codecData.data.clear();
+        return false;
+    }
+
+    auto from = 256;
+    for(auto && e : codecData.grammar.getRoundEnds()) {
+        std::unordered_map<u32, u16> roundMap;
+        for(auto sym = from; sym < e; sym++) {
+            roundMap[u32(codecData.grammar.getLeft(sym)) << 16 | codecData.grammar.getRight(sym)] = (u16)sym;
+        }
+        codecData.roundMaps.push_back(roundMap);
+        from = e;
+    }
+    return true;
+}
+
+/// Cached for threads, for callers working block by block without a table wide codec data
+const CompressLib::GrammarCodecData* CompressLib::getGrammarCodecData(const std::vector<char>& data)
+{
+    static thread_local GrammarCodecData codecData;
+    if (codecData.data != data && !loadGrammarCodecData(codecData, data)) {
+        return nullptr;
+    }
+    return &codecData;
+}
+
+int CompressLib::compressGrammar(char *dest, const char *src, int slen, const std::vector<char>& grammarData)
+{
+    auto codecData = getGrammarCodecData(grammarData);
+    return codecData ? compressGrammar(dest, src, slen, *codecData) : -1;
+}
+
+/// Return a size larger than slen if the block is not worth to be encoded
+int CompressLib::compressGrammar(char *dest, const char *src, int slen, const GrammarCodecData& codecData)
+{
+    assert(dest && src && slen > 0);
+
+    static thread_local std::vector<u16> symbols;
+    symbols.assign((const u8*)src, (const u8*)src + slen);
+    for(auto && roundMap : codecData.roundMaps) {
+        replaceGrammarPairs(symbols, roundMap);
+    }
+
+    /// codes are written from the most significant bit
+    auto& grammar = codecData.grammar;
+    auto d = (u8*)dest;
+    u64 bitBuf = 0;
+    auto bitCnt = 0, dlen = 0;
+    for(auto && sym : symbols) {
+        auto len = grammar.getCodeLength(sym);
+        bitBuf = bitBuf << len | grammar.getCode(sym);
+        bitCnt += len;
+        while (bitCnt >= 8) {
+            bitCnt -= 8;
+            d[dlen++] = (u8)(bitBuf >> bitCnt);
+        }
+        if (dlen >= slen) {
+            return slen + 1;
+        }
+    }
+    if (bitCnt > 0) {
+        d[dlen++] = (u8)(bitBuf << (8 - bitCnt));
+    }
+
+#ifdef TEST_DECOMPRESS
+    char *tmpBuf = (char*)malloc(slen + 64);
+    auto x = grammar.decodeBlock(dest, dlen, tmpBuf, slen);
+    assert(x == slen && memcmp(tmpBuf, src, slen) == 0);
+    free(tmpBuf);
+#endif
+    return dlen;
+}
+
+int CompressLib::decompressGrammar(char *dest, int uncompresslen, const char *src, int slen, const std::vector<char>& grammarData)
+{
+    auto codecData = getGrammarCodecData(grammarData);
+    return codecData ? codecData->grammar.decodeBlock(src, slen, dest, uncompresslen) : -1;
+}
+
 ///////
 extern int MaxGenExtraThreads;
 
-void compressABlock(int threadIdx, int blockIdx, char *dest, int* compSz, const char *src, int srcSize)
+int CompressLib::compressBlock(char *dest, const char *src, int slen, EgtbCodec codec, const std::vector<char>* dict, const GrammarCodecData* codecData)
+{
+    if (codec == EgtbCodec::grammar && codecData) {
+        return compressGrammar(dest, src, slen, *codecData);
+    }
+    return compress(dest, src, slen, codec, dict);
+}
+
+void CompressLib::compressABlock(int threadIdx, int blockIdx, char *dest, int* compSz, const char *src, int srcSize, EgtbCodec codec, const std::vector<char>* dict, const GrammarCodecData* codecData)
 {
     assert(srcSize > 0 && src && dest && compSz);
-    *compSz = CompressLib::compress(dest, src, srcSize); assert(*compSz > 0);
+    *compSz = compressBlock(dest, src, srcSize, codec, dict, codecData); assert(*compSz > 0);
 //    std::cout << "compressABlock DONE, threadIdx: " << threadIdx << ", blockIdx: " << blockIdx << ", srcSize: " << srcSize << ", *compSz: " << *compSz << std::endl;
 }
 
 #define MAX_THREAD_NUM	300
-i64 CompressLib::compressAllBlocks(int blockSize, u8* blocktable, char *dest, const char *src, i64 slen) {
+i64 CompressLib::compressAllBlocks(int blockSize, u8* blocktable, char *dest, const char *src, i64 slen, EgtbCodec codec, const std::vector<char>* dict) {
     assert(blockSize > 128 && blocktable && dest && src && slen > 0);
     assert(EGTB_SMALL_COMPRESS_SIZE + 1 == EGTB_UNCOMPRESS_BIT);
 	assert(MaxGenExtraThreads < MAX_THREAD_NUM);
 
+    /// the grammar is parsed once for the table, not again by every block thread
+    GrammarCodecData grammarCodecData;
+    const GrammarCodecData* codecData = nullptr;
+    if (codec == EgtbCodec::grammar) {
+        if (!dict || !loadGrammarCodecData(grammarCodecData, *dict)) {
+            return -1;
+        }
+        codecData = &grammarCodecData;
+    }
+
     if (MaxGenExtraThreads == 0) {
-        return compressAllBlocksSingleThread(blockSize, blocktable, dest, src, slen);
+        return compressAllBlocksSingleThread(blockSize, blocktable, dest, src, slen, codec, dict, codecData);
     }
 
     int compSizes[MAX_THREAD_NUM];
@@ -139,7 +657,7 @@ i64 CompressLib::compressAllBlocks(int blockSize, u8* blocktable, char *dest, co
             auto left = slen - (i64)(s - src);
             auto sSize = (int)std::min<i64>(left, (i64)blockSize); assert(sSize > 0);
 
-            threadVec.push_back(std::thread(&compressABlock, j, i + j, tmpBuf[j],  compSizes + j, s, sSize));
+            threadVec.push_back(std::thread(&compressABlock, j, i + j, tmpBuf[j],  compSizes + j, s, sSize, codec, dict, codecData));
         }
 
         for (auto && t : threadVec) {
@@ -190,7 +708,7 @@ i64 CompressLib::compressAllBlocks(int blockSize, u8* blocktable, char *dest, co
 }
 
 ////////////////
-i64 CompressLib::compressAllBlocksSingleThread(int blocksize, u8* blocktable, char *dest, const char *src, i64 slen) {
+i64 CompressLib::compressAllBlocksSingleThread(int blocksize, u8* blocktable, char *dest, const char *src, i64 slen, EgtbCodec codec, const std::vector<char>* dict, const GrammarCodecData* codecData) {
     assert(blocksize > 128 && blocktable && dest && src && slen > 0);
     assert(EGTB_SMALL_COMPRESS_SIZE + 1 == EGTB_UNCOMPRESS_BIT);
     
@@ -208,11 +726,11 @@ i64 CompressLib::compressAllBlocksSingleThread(int blocksize, u8* blocktable, ch
         
         auto curBlockSize = (int)std::min<i64>(left, (i64)blocksize); assert(curBlockSize > 0);
         
-        auto compSz = compress(p, s, curBlockSize); assert(compSz > 0);
+        auto compSz = compressBlock(p, s, curBlockSize, codec, dict, codecData); assert(compSz > 0);
         if (compSz > 0 && compSz + 128 < curBlockSize) {
             
 #ifdef TEST_DECOMPRESS
-            auto x = decompress(tmpbuf, curBlockSize, p, compSz);
+            auto x = decompress(tmpbuf, curBlockSize, p, compSz, codec, dict);
             assert(x > 0 && x == curBlockSize);
             assert(memcmp(s, tmpbuf, curBlockSize) == 0);
 #endif
@@ -248,7 +766,7 @@ i64 CompressLib::compressAllBlocksSingleThread(int blocksize, u8* blocktable, ch
     
     // test decompress
     tmpbuf = (char *)malloc(slen * 2);
-    i64 k = decompressAllBlocks(blocksize, (int)blocknum, blocktable, tmpbuf, slen, dest, compressedLen);
+    i64 k = decompressAllBlocks(blocksize, (int)blocknum, blocktable, tmpbuf, slen, dest, compressedLen, codec, dict);
     assert(k == slen);
     free(tmpbuf);
 #endif
@@ -256,7 +774,7 @@ i64 CompressLib::compressAllBlocksSingleThread(int blocksize, u8* blocktable, ch
     return compressedLen;
 }
 
-i64 CompressLib::decompressAllBlocks(int blocksize, int blocknum, int fromBlockIdx, int toBlockIdx, u8* blocktable, char *dest, i64 uncompressedlen, const char *src, i64 slen) {
+i64 CompressLib::decompressAllBlocks(int blocksize, int blocknum, int fromBlockIdx, int toBlockIdx, u8* blocktable, char *dest, i64 uncompressedlen, const char *src, i64 slen, EgtbCodec codec, const std::vector<char>* dict) {
     assert(slen > 0 && uncompressedlen >= slen);
     assert(fromBlockIdx >= 0 && fromBlockIdx < toBlockIdx && toBlockIdx <= blocknum);
 
@@ -310,7 +828,7 @@ i64 CompressLib::decompressAllBlocks(int blocksize, int blocknum, int fromBlockI
             auto left = uncompressedlen - (i64)(p - dest); assert(left > 0);
             auto curBlockSize = (int)std::min<i64>(left, (i64)blocksize);
 
-            auto originSz = decompress((char*)p, curBlockSize, s, blocksz);
+            auto originSz = decompress((char*)p, curBlockSize, s, blocksz, codec, dict);
             assert(originSz == curBlockSize || (i + 1 == blocknum && originSz > 0));
             p += originSz;
         }
@@ -322,9 +840,9 @@ i64 CompressLib::decompressAllBlocks(int blocksize, int blocknum, int fromBlockI
     return len;
 }
 
-i64 CompressLib::decompressAllBlocks(int blocksize, int blocknum, u8* blocktable, char *dest, i64 uncompressedlen, const char *src, i64 slen) {
+i64 CompressLib::decompressAllBlocks(int blocksize, int blocknum, u8* blocktable, char *dest, i64 uncompressedlen, const char *src, i64 slen, EgtbCodec codec, const std::vector<char>* dict) {
     assert(blocksize > 0 && blocknum > 0 && blocktable && dest && uncompressedlen > 0 && src && slen > 0);
-    auto len = decompressAllBlocks(blocksize, blocknum, 0, blocknum, blocktable, dest, uncompressedlen, src, slen);
+    auto len = decompressAllBlocks(blocksize, blocknum, 0, blocknum, blocktable, dest, uncompressedlen, src, slen, codec, dict);
     assert(uncompressedlen == len);
     return len;
 }
@@ -18,6 +18,9 @@
 #ifndef CompressLib_hpp
 #define CompressLib_hpp
 
+#include <unordered_map>
+#include <vector>
+
 #include "defs.h"
 #include "../fegtb/egtb.h"
 
@@ -27,25 +30,56 @@ namespace fegtb {
 class CompressLib {
 public:
 
-    static inline int compress(char *dest, const char *src, int slen) {
+    /// dictionaries are used by the lz codec, the grammar codec takes its grammar as the dictionary
+    static inline int compress(char *dest, const char *src, int slen, EgtbCodec codec = EgtbCodec::lzma, const std::vector<char>* dict = nullptr) {
+        if (codec == EgtbCodec::grammar) {
+            return dict ? compressGrammar(dest, src, slen, *dict) : -1;
+        }
+        if (codec == EgtbCodec::lz) {
+            return dict ? compressLz(dest, src, slen, dict->data(), (int)dict->size()) : compressLz(dest, src, slen);
+        }
         return compressLzma(dest, src, slen);
     }
-    static inline int decompress(char *dest, int uncompresslen, const char *src, int slen) {
+    static inline int decompress(char *dest, int uncompresslen, const char *src, int slen, EgtbCodec codec = EgtbCodec::lzma, const std::vector<char>* dict = nullptr) {
+        if (codec == EgtbCodec::grammar) {
+            return dict ? decompressGrammar(dest, uncompresslen, src, slen, *dict) : -1;
+        }
+        if (codec == EgtbCodec::lz) {
+            return dict ? decompressLz(dest, uncompresslen, src, slen, dict->data(), (int)dict->size()) : decompressLz(dest, uncompresslen, src, slen);
+        }
         return decompressLzma(dest, uncompresslen, src, slen);
     }
 
-    static i64 compressAllBlocks(int blocksize, u8* blocktable, char *dest, const char *src, i64 slen);
+    /// a dictionary trained from sample blocks, empty if the data is too small for it
+    static std::vector<char> trainDictionary(const char *src, i64 slen, int blocksize, int dictSize);
+    /// a grammar learnt from sample blocks, for the grammar codec
+    static std::vector<char> trainGrammar(const char *src, i64 slen, int blocksize);
+
+    static i64 compressAllBlocks(int blocksize, u8* blocktable, char *dest, const char *src, i64 slen, EgtbCodec codec = EgtbCodec::lzma, const std::vector<char>* dict = nullptr);
 
 
-    static i64 decompressAllBlocks(int blocksize, int blocknum, u8* blocktable, char *dest, i64 uncompressedlen, const char *src, i64 slen);
-    static i64 decompressAllBlocks(int blocksize, int blocknum, int fromBlockIdx, int toBlockIdx, u8* blocktable, char *dest, i64 uncompressedlen, const char *src, i64 slen);
+    static i64 decompressAllBlocks(int blocksize, int blocknum, u8* blocktable, char *dest, i64 uncompressedlen, const char *src, i64 slen, EgtbCodec codec = EgtbCodec::lzma, const std::vector<char>* dict = nullptr);
+    static i64 decompressAllBlocks(int blocksize, int blocknum, int fromBlockIdx, int toBlockIdx, u8* blocktable, char *dest, i64 uncompressedlen, const char *src, i64 slen, EgtbCodec codec = EgtbCodec::lzma, const std::vector<char>* dict = nullptr);
     static i64 decompressAllBlocks(int numExtraThreads, int blocksize, int blocknum, u8* blocktable, char *dest, i64 uncompressedlen, const char *src, i64 slen);
 
 private:
     static int compressLzma(char *dest, const char *src, int slen);
     static int decompressLzma(char *dest, int uncompresslen, const char *src, int slen);
-
-    static i64 compressAllBlocksSingleThread(int blocksize, u8* blocktable, char *dest, const char *src, i64 slen);
+    static int compressLz(char *dest, const char *src, int slen, const char* dict = nullptr, int dictLen = 0);
+    /// parsed grammar with maps of its rounds for encoding
+    struct GrammarCodecData;
+    static bool loadGrammarCodecData(GrammarCodecData& codecData, const std::vector<char>& data);
+    static const GrammarCodecData* getGrammarCodecData(const std::vector<char>& data);
+    static int compressGrammar(char *dest, const char *src, int slen, const std::vector<char>& grammarData);
+    static int compressGrammar(char *dest, const char *src, int slen, const GrammarCodecData& codecData);
+    static int decompressGrammar(char *dest, int uncompresslen, const char *src, int slen, const std::vector<char>& grammarData);
+    static void replaceGrammarPairs(std::vector<u16>& symbols, const std::unordered_map<u32, u16>& roundMap);
+    static std::vector<u8> createHuffmanCodeLengths(std::vector<i64> freqs, int maxLen);
+
+    /// codecData, if any, is the grammar already parsed once for the whole table
+    static int compressBlock(char *dest, const char *src, int slen, EgtbCodec codec, const std::vector<char>* dict, const GrammarCodecData* codecData);
+    static void compressABlock(int threadIdx, int blockIdx, char *dest, int* compSz, const char *src, int srcSize, EgtbCodec codec, const std::vector<char>* dict, const GrammarCodecData* codecData);
+    static i64 compressAllBlocksSingleThread(int blocksize, u8* blocktable, char *dest, const char *src, i64 slen, EgtbCodec codec, const std::vector<char>* dict, const GrammarCodecData* codecData);
 
 };
 
@@ -27,6 +27,10 @@ bool EgtbGenDb::useTempFiles = false;
 bool EgtbGenDb::useBackward = true;
 bool EgtbGenDb::verifyMode = true;
 i64 EgtbGenDb::maxEndgameSize = -1;
+bool EgtbGenDb::twoLevelCompressTable = true;
+EgtbCodec EgtbGenDb::codec = EgtbCodec::lzma;
+int EgtbGenDb::dictSize = 0;
+int EgtbGenDb::compressBlockSize = 0;
 
 #ifdef _FELICITY_CHESS_
 static const std::string pieceSorting = "0987654321";
@@ -81,6 +81,10 @@ public:
     static bool useBackward;
     static bool verifyMode;
     static i64 maxEndgameSize;
+    static bool twoLevelCompressTable; // write two-level compress tables
+    static EgtbCodec codec; // for compressing blocks
+    static int dictSize; // of the lz codec, 0 for none
+    static int compressBlockSize; // 0 for the default one
 
 protected:
     EgtbGenFile* egtbFile = nullptr;
@@ -93,6 +97,8 @@ public:
 
     
     bool verifyData_chunk(int threadIdx, EgtbFile* pEgtbFile);
+    void createWDL_chunk(int threadIdx, EgtbFile* pEgtbFile, EgtbGenFile* pWdlFile);
+    void recompress_chunk(int threadIdx, EgtbFile* pEgtbFile, EgtbGenFile* pGenFile);
     bool verifyData(EgtbFile* pEgtbFile);
     
     virtual bool verifyKeys(const std::string& name, EgtbType egtbType) const;
@@ -121,6 +127,14 @@ public:
     void createTestEPD(const std::string& path, int countPerEndgame = 10);
     void testEPD(const std::string& path);
 
+    /// Create WDL tables from DTM ones
+    void createWDL(const std::vector<std::string>& nameVec);
+    bool createWDL(EgtbFile* pEgtbFile);
+
+    /// rewrite tables with the current compress options, or just report those options
+    void recompress(const std::vector<std::string>& nameVec, bool reportOnly, CompressMode compressMode = CompressMode::compress);
+    bool recompress(EgtbFile* pEgtbFile, bool reportOnly, CompressMode compressMode);
+
 protected:
 
     void writeLog();
@@ -0,0 +1,126 @@
+/**
+ This file is part of Felicity Egtb, distributed under MIT license.
+
+ * Copyright (c) 2024 Nguyen Hong Pham (github@nguyenpham)
+ * Copyright (c) 2024 developers
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ */
+
+#include <thread>
+
+#include "egtbgendb.h"
+
+#include "../base/funcs.h"
+
+using namespace fegtb;
+using namespace bslib;
+
+/*
+ * Recompress existing DTM tables with the current compress options (block size, codec,
+ * dictionary, compress tables, filling illegal cells). Files are rewritten in place
+ */
+void EgtbGenDb::recompress(const std::vector<std::string>& nameVec, bool reportOnly, CompressMode compressMode)
+{
+    auto count = 0, succ = 0, missing = 0;
+
+    for(auto && endgameName : nameVec) {
+        auto pos = nameMap.find(endgameName);
+        if (pos != nameMap.end() && pos->second) {
+            count++;
+            if (recompress(pos->second, reportOnly, compressMode)) {
+                succ++;
+            }
+            removeAllProbedBuffers();
+        } else {
+            std::cerr << "Error: missing " << endgameName << std::endl;
+            missing++;
+        }
+    }
+
+    if (!reportOnly) {
+        std::cout << "Recompress COMPLETED. total: " << count << ", recompressed: " << succ << ", missing: " << missing << std::endl;
+    }
+}
+
+void EgtbGenDb::recompress_chunk(int threadIdx, EgtbFile* pEgtbFile, EgtbGenFile* pGenFile)
+{
+    auto& rcd = threadRecordVec.at(threadIdx);
+
+    for (auto sd = 0; sd < 2; sd++) {
+        auto side = static_cast<Side>(sd);
+        for (auto idx = rcd.fromIdx; idx < rcd.toIdx; idx++) {
+            pGenFile->setBufScore(idx, pEgtbFile->getScore(idx, side), side);
+        }
+    }
+}
+
+bool EgtbGenDb::recompress(EgtbFile* pEgtbFile, bool reportOnly, CompressMode compressMode)
+{
+    assert(pEgtbFile);
+
+    pEgtbFile->checkToLoadHeaderAndTables(Side::none);
+    if (pEgtbFile->getLoadStatus() == EgtbLoadStatus::error
+        || !pEgtbFile->getHeader()->isSide(Side::white) || !pEgtbFile->getHeader()->isSide(Side::black)) {
+        std::cerr << "Error: cannot load both sides of " << pEgtbFile->getName() << std::endl;
+        return false;
+    }
+
+    auto folder = pEgtbFile->getPath(Side::white);
+    auto p = folder.find_last_of("/\\");
+    folder = p == std::string::npos ? "." : folder.substr(0, p);
+
+    /// same data format, scores are copied as they are
+    auto srcHeader = pEgtbFile->getHeader();
+    EgtbGenFile genFile;
+    genFile.create(pEgtbFile->getName(), pEgtbFile->getEgtbType(), srcHeader->getOrder());
+    auto prop = genFile.getHeader()->getProperty() & ~EGTB_PROP_2BYTES;
+    genFile.getHeader()->setProperty(prop | (srcHeader->getProperty() & EGTB_PROP_2BYTES));
+    genFile.getHeader()->setDtm_max(srcHeader->getDtm_max());
+
+    if (!genFile.createBuffersForGenerating()) {
+        std::cerr << "Error: cannot allocate memory for " << pEgtbFile->getName() << std::endl;
+        return false;
+    }
+
+    setupThreadRecords(pEgtbFile->getSize());
+    {
+        std::vector<std::thread> threadVec;
+        for (auto i = 1; i < threadRecordVec.size(); ++i) {
+            threadVec.push_back(std::thread(&EgtbGenDb::recompress_chunk, this, i, pEgtbFile, &genFile));
+        }
+
+        recompress_chunk(0, pEgtbFile, &genFile);
+
+        for (auto && t : threadVec) {
+            t.join();
+        }
+    }
+
+    if (reportOnly) {
+        genFile.printCompressReport();
+        return true;
+    }
+
+    /// illegal cells of optimized tables are gone, keep the flag
+    if (srcHeader->getProperty() & EGTB_PROP_COMPRESS_OPTIMIZED) {
+        compressMode = CompressMode::compress_optimizing;
+    }
+    pEgtbFile->removeBuffers();
+
+    if (!genFile.saveFile(folder, compressMode)) {
+        std::cerr << "Error: cannot save files for " << genFile.getName() << std::endl;
+        return false;
+    }
+
+    std::cout << genFile.getName() << " recompressed, block size: " << genFile.getCompressBlockSize() << std::endl;
+    return true;
+}
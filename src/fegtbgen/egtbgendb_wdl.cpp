@@ -0,0 +1,132 @@
+/**
+ This file is part of Felicity Egtb, distributed under MIT license.
+
+ * Copyright (c) 2024 Nguyen Hong Pham (github@nguyenpham)
+ * Copyright (c) 2024 developers
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ */
+
+#include <thread>
+
+#include "egtbgendb.h"
+
+#include "../base/funcs.h"
+
+using namespace fegtb;
+using namespace bslib;
+
+/*
+ * WDL tables are derived from DTM ones. They keep only win/draw/loss, 2 bits per item,
+ * and are compressed with the same block scheme
+ */
+void EgtbGenDb::createWDL(const std::vector<std::string>& nameVec)
+{
+    std::cout << "Found total endgames: " << egtbFileVec.size() << std::endl;
+
+    auto count = 0, succ = 0, missing = 0;
+
+    for(auto && endgameName : nameVec) {
+        std::cout << "\nCreate WDL for " << endgameName << std::endl;
+
+        auto pos = nameMap.find(endgameName);
+        if (pos != nameMap.end() && pos->second) {
+            count++;
+            if (createWDL(pos->second)) {
+                succ++;
+            }
+            removeAllProbedBuffers();
+        } else {
+            std::cerr << "Error: missing " << endgameName << std::endl;
+            missing++;
+        }
+    }
+    std::cout << "Create WDL COMPLETED. total: " << count << ", created: " << succ << ", missing: " << missing << std::endl;
+}
+
+void EgtbGenDb::createWDL_chunk(int threadIdx, EgtbFile* pEgtbFile, EgtbGenFile* pWdlFile)
+{
+    auto& rcd = threadRecordVec.at(threadIdx);
+
+    /// 4 items share a byte, ranges of threads must not split bytes
+    auto fromIdx = rcd.fromIdx & ~3LL;
+    auto toIdx = rcd.toIdx == pEgtbFile->getSize() ? rcd.toIdx : (rcd.toIdx & ~3LL);
+
+    /// cells whose DTM scores are missing or unreadable, counted rather than written as illegal ones
+    rcd.cnt = 0;
+
+    for (auto sd = 0; sd < 2; sd++) {
+        auto side = static_cast<Side>(sd);
+        for (auto idx = fromIdx; idx < toIdx; idx++) {
+            auto score = pEgtbFile->getScore(idx, side);
+            if (score != EGTB_SCORE_ILLEGAL && abs(score) > EGTB_SCORE_MATE) {
+                rcd.cnt++;
+                continue;
+            }
+            pWdlFile->setBufScore(idx, EgtbFile::scoreToWDL(score), side);
+        }
+    }
+}
+
+bool EgtbGenDb::createWDL(EgtbFile* pEgtbFile)
+{
+    assert(pEgtbFile);
+
+    pEgtbFile->checkToLoadHeaderAndTables(Side::none);
+    if (pEgtbFile->getLoadStatus() == EgtbLoadStatus::error
+        || !pEgtbFile->getHeader()->isSide(Side::white) || !pEgtbFile->getHeader()->isSide(Side::black)) {
+        std::cerr << "Error: cannot load both sides of " << pEgtbFile->getName() << std::endl;
+        return false;
+    }
+
+    /// stored next to the DTM files
+    auto folder = pEgtbFile->getPath(Side::white);
+    auto p = folder.find_last_of("/\\");
+    folder = p == std::string::npos ? "." : folder.substr(0, p);
+
+    EgtbGenFile wdlFile;
+    wdlFile.create(pEgtbFile->getName(), EgtbType::wdl, pEgtbFile->getHeader()->getOrder());
+    if (!wdlFile.createBuffersForGenerating()) {
+        std::cerr << "Error: cannot allocate memory for " << pEgtbFile->getName() << std::endl;
+        return false;
+    }
+
+    setupThreadRecords(pEgtbFile->getSize());
+    {
+        std::vector<std::thread> threadVec;
+        for (auto i = 1; i < threadRecordVec.size(); ++i) {
+            threadVec.push_back(std::thread(&EgtbGenDb::createWDL_chunk, this, i, pEgtbFile, &wdlFile));
+        }
+
+        createWDL_chunk(0, pEgtbFile, &wdlFile);
+
+        for (auto && t : threadVec) {
+            t.join();
+        }
+    }
+
+    i64 badCnt = 0;
+    for (auto && rcd : threadRecordVec) {
+        badCnt += rcd.cnt;
+    }
+    if (badCnt > 0) {
+        std::cerr << "Error: " << badCnt << " cells of " << pEgtbFile->getName() << " have missing or unreadable DTM scores, WDL files are not created" << std::endl;
+        return false;
+    }
+
+    if (!wdlFile.saveFile(folder, CompressMode::compress)) {
+        std::cerr << "Error: cannot save WDL files for " << pEgtbFile->getName() << std::endl;
+        return false;
+    }
+
+    std::cout << "       " << pEgtbFile->getName() << " saved " << wdlFile.getPath(Side::white) << std::endl;
+    return true;
+}
@@ -16,6 +16,9 @@
  */
 
 #include <thread>
+#include <chrono>
+#include <iomanip>
+#include <unordered_map>
 
 #include "../fegtb/egtb.h"
 #include "../base/funcs.h"
@@ -77,7 +80,9 @@ void EgtbGenFile::create(const std::string& name, EgtbType _egtbType, u32 order)
 
     header->setOrder(order);
     
-    if (EgtbGenDb::twoBytes) {
+    if (egtbType == EgtbType::wdl) {
+        header->addProperty(EGTB_PROP_WDL);
+    } else if (EgtbGenDb::twoBytes) {
         header->addProperty(EGTB_PROP_2BYTES);
         assert(isTwoBytes());
     }
@@ -128,6 +133,10 @@ int EgtbGenFile::getBufScore(i64 idx, Side side)
 
 bool EgtbGenFile::setBufScore(i64 idx, int score, Side side)
 {
+    if (isWDL()) {
+        return setBufWDL(idx, scoreToWDLCell(score), side);
+    }
+
     if (isTwoBytes()) {
         return setBuf2Bytes(idx, score, side);
     }
@@ -136,6 +145,19 @@ bool EgtbGenFile::setBufScore(i64 idx, int score, Side side)
     return setBuf(idx, cell, side);
 }
 
+int EgtbGenFile::scoreToWDLCell(int score) {
+    switch (score) {
+        case EGTB_WDL_DRAW:
+            return TB_WDL_DRAW;
+        case EGTB_WDL_WIN:
+            return TB_WDL_WIN;
+        case EGTB_WDL_LOSS:
+            return TB_WDL_LOSS;
+        default:
+            return TB_WDL_ILLEGAL;
+    }
+}
+
 char EgtbGenFile::scoreToCell(int score) {
     if (score <= EGTB_SCORE_MATE) {
         if (score == EGTB_SCORE_DRAW) return TB_DRAW;
@@ -179,10 +201,7 @@ char EgtbGenFile::scoreToCell(int score) {
 bool EgtbGenFile::createBuffersForGenerating() {
     memMode = EgtbMemMode::all;
     auto sz = getSize();
-    auto bufSz = sz;
-    if (isTwoBytes()) {
-        bufSz += bufSz;
-    }
+    auto bufSz = getDataSize();
 
     bool r = createBuf(bufSz, Side::black) && createBuf(bufSz, Side::white);
     startpos[0] = startpos[1] = 0;
@@ -523,6 +542,184 @@ bool EgtbGenFile::existFileName(const std::string& folderName, const std::string
 
 static i64 totalSize = 0, illegalCnt = 0, drawCnt = 0, compressedUndeterminedCnt = 0;
 
+/// Convert a flat compress table (cumulative offsets, 4 or 5 bytes per block) into a two-level one
+static std::vector<u8> createTwoLevelCompressTable(const u8* blocktable, int blockNum, int bytePerItem)
+{
+    auto groupCnt = (blockNum + EGTB_2LEVEL_GROUP_BLOCKS - 1) / EGTB_2LEVEL_GROUP_BLOCKS;
+    std::vector<u8> vec(groupCnt * sizeof(i64) + blockNum * sizeof(u16));
+    auto groupTable = (i64*)vec.data();
+    auto sizeTable = (u16*)(vec.data() + groupCnt * sizeof(i64));
+
+    i64 lastOffset = 0;
+    for (auto i = 0; i < blockNum; i++) {
+        i64 offset;
+        bool uncompressed;
+        if (bytePerItem == 4) {
+            auto item = ((const u32*)blocktable)[i];
+            offset = item & EGTB_SMALL_COMPRESS_SIZE;
+            uncompressed = (item & EGTB_UNCOMPRESS_BIT) != 0;
+        } else {
+            auto item = *(const i64*)(blocktable + 5 * i);
+            offset = item & EGTB_LARGE_COMPRESS_SIZE;
+            uncompressed = (item & EGTB_UNCOMPRESS_BIT_FOR_LARGE_COMPRESSTABLE) != 0;
+        }
+
+        if (i % EGTB_2LEVEL_GROUP_BLOCKS == 0) {
+            groupTable[i / EGTB_2LEVEL_GROUP_BLOCKS] = lastOffset;
+        }
+
+        auto sz = offset - lastOffset;
+        assert(sz > 0 && sz <= EGTB_2LEVEL_MAX_BLOCK_SIZE);
+        sizeTable[i] = (u16)(sz | (uncompressed ? EGTB_2LEVEL_UNCOMPRESS_BIT : 0));
+        lastOffset = offset;
+    }
+    return vec;
+}
+
+/*
+ * Illegal cells are never probed, their values don't matter. Fill them to make blocks easier
+ * to compress: a run of illegal cells takes the value of its neighbours. When they differ,
+ * it takes the more frequent one in the block, so the block keeps fewer distinct runs and
+ * its dominant score becomes more dominant. Blocks are independent, they are filled in parallel.
+ * Legal but unreachable positions are not detected, they keep their scores
+ */
+void EgtbGenFile::fillDontCareCells(Side side)
+{
+    auto blockItemCnt = (i64)getCompressBlockItemCnt();
+    auto blockCnt = (getSize() + blockItemCnt - 1) / blockItemCnt;
+
+    setupThreadRecords(blockCnt);
+
+    std::vector<std::thread> threadVec;
+    for (auto i = 1; i < threadRecordVec.size(); ++i) {
+        threadVec.push_back(std::thread(&EgtbGenFile::fillDontCareCells_chunk, this, i, side));
+    }
+
+    fillDontCareCells_chunk(0, side);
+
+    for (auto && t : threadVec) {
+        t.join();
+    }
+}
+
+void EgtbGenFile::fillDontCareCells_chunk(int threadIdx, Side side)
+{
+    auto& rcd = threadRecordVec.at(threadIdx);
+    auto blockItemCnt = (i64)getCompressBlockItemCnt();
+
+    std::vector<int> scores;
+    std::unordered_map<int, int> scoreCnts;
+
+    for (auto blockIdx = rcd.fromIdx; blockIdx < rcd.toIdx; blockIdx++) {
+        auto fromIdx = blockIdx * blockItemCnt;
+        auto n = (int)std::min<i64>(blockItemCnt, getSize() - fromIdx);
+
+        scores.resize(n);
+        scoreCnts.clear();
+        for (auto i = 0; i < n; i++) {
+            auto score = getScore(fromIdx + i, side);
+            scores[i] = score;
+            if (score != EGTB_SCORE_ILLEGAL) {
+                scoreCnts[score]++;
+            }
+        }
+
+        /// nothing to extend, any constant compresses the same
+        if (scoreCnts.empty()) {
+            for (auto i = 0; i < n; i++) {
+                setBufScore(fromIdx + i, EGTB_SCORE_DRAW, side);
+            }
+            continue;
+        }
+
+        for (auto i = 0; i < n; ) {
+            if (scores[i] != EGTB_SCORE_ILLEGAL) {
+                i++;
+                continue;
+            }
+
+            auto e = i + 1;
+            while (e < n && scores[e] == EGTB_SCORE_ILLEGAL) {
+                e++;
+            }
+
+            auto left = i > 0 ? scores[i - 1] : EGTB_SCORE_ILLEGAL;
+            auto right = e < n ? scores[e] : EGTB_SCORE_ILLEGAL;
+
+            auto score = left;
+            if (left == EGTB_SCORE_ILLEGAL || (right != EGTB_SCORE_ILLEGAL && scoreCnts[right] > scoreCnts[left])) {
+                score = right;
+            }
+
+            for (; i < e; i++) {
+                setBufScore(fromIdx + i, score, side);
+            }
+        }
+    }
+}
+
+void EgtbGenFile::printCompressReport()
+{
+    /// large tables are measured by samples
+    const i64 maxSampleSz = 16 * 1024 * 1024L;
+
+    auto codec = EgtbGenDb::codec;
+    std::cout << getName() << ", codec: " << (codec == EgtbCodec::grammar ? "grammar" : codec == EgtbCodec::lz ? "lz" : "lzma")
+              << (codec == EgtbCodec::lz && EgtbGenDb::dictSize > 0 ? " with dictionary" : "") << std::endl;
+    std::cout << "  side   block      sampled   compressed   ratio   decode us/block   decode MB/s" << std::endl;
+
+    auto bufSz = getDataSize();
+    for(auto sd = 0; sd < 2; sd++) {
+        if (!pBuf[sd]) {
+            continue;
+        }
+        for(auto lg = EGTB_MIN_COMPRESS_BLOCK_LOG; lg <= EGTB_MAX_COMPRESS_BLOCK_LOG; lg++) {
+            auto blocksize = 1 << lg;
+            auto blockNum = (bufSz + blocksize - 1) / blocksize;
+            auto sampleNum = std::max<i64>(1, std::min<i64>(blockNum, maxSampleSz / blocksize));
+
+            std::vector<char> dict;
+            if (codec == EgtbCodec::grammar) {
+                dict = CompressLib::trainGrammar(pBuf[sd], bufSz, blocksize);
+            } else if (codec == EgtbCodec::lz && EgtbGenDb::dictSize > 0) {
+                dict = CompressLib::trainDictionary(pBuf[sd], bufSz, blocksize, EgtbGenDb::dictSize);
+            }
+            auto pDict = dict.empty() ? nullptr : &dict;
+
+            std::vector<char> compBuf(blocksize * 2 + 1024), decompBuf(blocksize);
+            i64 sampledSz = 0, compSz = (i64)dict.size(), decodeNs = 0;
+            for(i64 i = 0; i < sampleNum; i++) {
+                auto blockIdx = i * blockNum / sampleNum;
+                auto src = pBuf[sd] + blockIdx * blocksize;
+                auto sz = (int)std::min<i64>(blocksize, bufSz - blockIdx * blocksize);
+                sampledSz += sz;
+
+                auto k = CompressLib::compress(compBuf.data(), src, sz, codec, pDict);
+                auto startTime = std::chrono::steady_clock::now();
+                /// stored as it is, the same way as saving files
+                if (k <= 0 || k + 128 >= sz) {
+                    memcpy(decompBuf.data(), src, sz);
+                    k = sz;
+                } else {
+                    auto r = CompressLib::decompress(decompBuf.data(), sz, compBuf.data(), k, codec, pDict);
+                    assert(r == sz); (void)r;
+                }
+                decodeNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+                compSz += k;
+            }
+
+            std::cout << "  " << std::setw(4) << (sd == 0 ? "b" : "w")
+                      << std::setw(6) << (blocksize >> 10) << " KB"
+                      << std::setw(13) << sampledSz
+                      << std::setw(13) << compSz
+                      << std::setw(8) << std::fixed << std::setprecision(3) << (double)compSz / sampledSz
+                      << std::setw(18) << std::setprecision(1) << decodeNs / 1000.0 / sampleNum
+                      << std::setw(14) << std::setprecision(0) << (decodeNs ? sampledSz * 1000.0 / decodeNs : 0.0)
+                      << std::endl;
+        }
+    }
+}
+
 bool EgtbGenFile::saveFile(const std::string& folder, Side side, CompressMode compressMode)
 {
     assert(compressMode != compress_none);
@@ -545,7 +742,11 @@ bool EgtbGenFile::saveFile(const std::string& folder, Side side, CompressMode co
     }
 
     header->setProperty(header->getProperty() & ~EGTB_PROP_NEW);
+    header->setCompressBlockSize(EgtbGenDb::compressBlockSize);
     header->setProperty(header->getProperty() & ~(EGTB_PROP_LARGE_COMPRESSTABLE_B | EGTB_PROP_LARGE_COMPRESSTABLE_W));
+    header->setProperty(header->getProperty() & ~(EGTB_PROP_2LEVEL_COMPRESSTABLE_B | EGTB_PROP_2LEVEL_COMPRESSTABLE_W));
+    header->setProperty(header->getProperty() & ~(EGTB_PROP_CODEC_LZ_B | EGTB_PROP_CODEC_LZ_W | EGTB_PROP_DICT_B | EGTB_PROP_DICT_W));
+    header->setProperty(header->getProperty() & ~(EGTB_PROP_CODEC_GRAMMAR_B | EGTB_PROP_CODEC_GRAMMAR_W));
     
     if (compressMode == CompressMode::compress_optimizing) {
         header->addProperty(EGTB_PROP_COMPRESS_OPTIMIZED);
@@ -562,8 +763,7 @@ bool EgtbGenFile::saveFile(const std::string& folder, Side side, CompressMode co
 
     if (outfile) {
         auto size = getSize();
-        auto bufSz = size;
-        if (isTwoBytes()) bufSz += bufSz;
+        auto bufSz = getDataSize();
 
         if (compress) {
             totalSize += size;
@@ -577,67 +777,78 @@ bool EgtbGenFile::saveFile(const std::string& folder, Side side, CompressMode co
             i64 compBufSz = bufSz + 2 * blockNum + 2 * blocksize;
             char *compBuf = (char *)malloc(compBufSz);
 
-            /*
-             * Convert all illegal to previous one to improve compress ratio
-             */
             if (compressMode == CompressMode::compress_optimizing) {
-                
-                auto sameLastCell = false;
-                auto lastScore = 0;
-                for (i64 i = 0; i < size; i++) {
-                    auto score = getScore(i, side);
-                    if (score == EGTB_SCORE_ILLEGAL) {
-                        auto b = true;
-                        if (!sameLastCell && i + 1 < size) {
-                            auto score2 = getScore(i + 1, side);
-                            if (score2 != EGTB_SCORE_ILLEGAL) {
-                                score = score2;
-                                b = false;
-                            }
-                        }
-                        if (b) {
-                            sameLastCell = true;
-                            score = lastScore;
-                        }
-                        setBufScore(i, score, side);
-                    } else {
-                        sameLastCell = lastScore == score;
-                    }
-                    
-                    lastScore = score;
-                }
+                fillDontCareCells(side);
             }
 
-            int64_t compSz = CompressLib::compressAllBlocks(blocksize, blocktable, compBuf, (char*)pBuf[sd], bufSz);
+            /// shared by all blocks of that side, the grammar codec stores its grammar as the dictionary
+            std::vector<char> dict;
+            if (EgtbGenDb::codec == EgtbCodec::grammar) {
+                dict = CompressLib::trainGrammar((char*)pBuf[sd], bufSz, blocksize);
+            } else if (EgtbGenDb::codec == EgtbCodec::lz && EgtbGenDb::dictSize > 0) {
+                dict = CompressLib::trainDictionary((char*)pBuf[sd], bufSz, blocksize, EgtbGenDb::dictSize);
+            }
+
+            int64_t compSz = CompressLib::compressAllBlocks(blocksize, blocktable, compBuf, (char*)pBuf[sd], bufSz, EgtbGenDb::codec, dict.empty() ? nullptr : &dict);
             assert(compSz < bufSz);
 
-            if (compSz > bufSz || compSz > EGTB_LARGE_COMPRESS_SIZE) {
+            if (compSz <= 0 || compSz > bufSz || compSz > EGTB_LARGE_COMPRESS_SIZE) {
                 std::cerr << "\nError: cannot compress compSz (" << compSz << " > size (" << size << ")\n";
                 exit(-1);
             }
 
+            if (EgtbGenDb::codec == EgtbCodec::lz) {
+                header->addProperty(EGTB_PROP_CODEC_LZ_B << sd);
+            } else if (EgtbGenDb::codec == EgtbCodec::grammar) {
+                header->addProperty(EGTB_PROP_CODEC_GRAMMAR_B << sd);
+            }
+            if (!dict.empty()) {
+                header->addProperty(EGTB_PROP_DICT_B << sd);
+            }
+
             auto bytePerItem = 4;
+            auto twoLevel = EgtbGenDb::twoLevelCompressTable && blocksize <= EGTB_2LEVEL_MAX_BLOCK_SIZE;
+            if (EgtbGenDb::twoLevelCompressTable && !twoLevel) {
+                std::cout << "NOTE: Using the flat compress table, block size " << blocksize << " is too large for the two-level one\n\n";
+            }
 
             if (compSz > EGTB_SMALL_COMPRESS_SIZE) {
                 bytePerItem = 5;
                 assert( (*((i64*)(blocktable + 5 * (blockNum - 1))) & EGTB_LARGE_COMPRESS_SIZE) == compSz);
 
-                header->addProperty(EGTB_PROP_LARGE_COMPRESSTABLE_B << sd);
-                std::cout << "NOTE: Using 5 bytes per item for compress table\n\n";
+                if (!twoLevel) {
+                    header->addProperty(EGTB_PROP_LARGE_COMPRESSTABLE_B << sd);
+                    std::cout << "NOTE: Using 5 bytes per item for compress table\n\n";
+                }
             } else {
                 assert((*((u32*)blocktable + blockNum - 1) & EGTB_SMALL_COMPRESS_SIZE) == compSz);
             }
 
             auto blockTableSize = blockNum * bytePerItem;
 
+            /// sizes of blocks are small, 2 bytes each plus an offset per group
+            std::vector<u8> twoLevelTable;
+            if (twoLevel) {
+                twoLevelTable = createTwoLevelCompressTable(blocktable, blockNum, bytePerItem);
+                blockTableSize = (int)twoLevelTable.size();
+                header->addProperty(EGTB_PROP_2LEVEL_COMPRESSTABLE_B << sd);
+            }
+
             if (r && !saveHeader(outfile)) {
                 r = false;
             }
             
-            if (r && !outfile.write ((char*)blocktable, blockTableSize)) {
+            if (r && !outfile.write (twoLevel ? (char*)twoLevelTable.data() : (char*)blocktable, blockTableSize)) {
                 r = false;
             }
 
+            if (r && !dict.empty()) {
+                u32 dictSz = (u32)dict.size();
+                if (!outfile.write((char*)&dictSz, sizeof(dictSz)) || !outfile.write(dict.data(), dictSz)) {
+                    r = false;
+                }
+            }
+
             assert(compBuf);
             if (r && compBuf && !outfile.write((char*)compBuf, compSz)) {
                 r = false;
@@ -710,13 +921,13 @@ void EgtbGenFile::convert1byteTo2() {
     
     for(auto sd = 0; sd < 2; sd++) {
         auto side = static_cast<Side>(sd);
-        auto p = (i16*)malloc(getSize() * 2 + 64);
+        auto p = (i16*)allocBuffer(getSize() * 2 + 64);
         for(i64 idx = 0; idx < getSize(); ++idx) {
             auto score = getScore(idx, side);
             p[idx] = score;
         }
         
-        free(pBuf[sd]);
+        freeBuffer(pBuf[sd]);
         pBuf[sd] = (char*)p;
     }
 
@@ -820,7 +1031,7 @@ bool EgtbGenFile::verifyKeys()
 void EgtbGenFile::createFlagBuffer() {
     removeFlagBuffer();
     auto flagLen = getSize() / 2 + 16;
-    flags = (uint8_t*) malloc(flagLen);
+    flags = (uint8_t*)allocBuffer(flagLen);
     memset(flags, 0, flagLen);
 }
 
@@ -828,7 +1039,7 @@ void EgtbGenFile::createFlagBuffer() {
 void EgtbGenFile::removeFlagBuffer()
 {
     if (flags) {
-        free(flags);
+        freeBuffer((char*)flags);
         flags = nullptr;
     }
 }
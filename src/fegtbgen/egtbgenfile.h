@@ -47,6 +47,7 @@ namespace fegtb {
         void    setSize(i64 sz) { size = sz; }
 
         static char scoreToCell(int score);
+        static int scoreToWDLCell(int score);
 
         virtual bool isValidHeader() const {
             return header && header->isValid();
@@ -55,6 +56,13 @@ namespace fegtb {
     public:
         bool    saveFile(const std::string& folder, bslib::Side side, CompressMode compressMode);
 
+        /// give illegal cells the values compressing best, they can't be probed as illegal anymore
+        void    fillDontCareCells(bslib::Side side);
+        void    fillDontCareCells_chunk(int threadIdx, bslib::Side side);
+
+        /// compressed sizes and decoding times of the data for all allowed block sizes
+        void    printCompressReport();
+
         void    checkAndConvert2bytesTo1();
         void    convert1byteTo2();
         
@@ -77,6 +85,19 @@ namespace fegtb {
             return false;
         }
 
+        /// items of the same byte must not be set by different threads
+        bool    setBufWDL(i64 idx, int cell, bslib::Side side) {
+            auto sd = static_cast<int>(side);
+            if (pBuf[sd] && idx >= startpos[sd] && idx < endpos[sd]) {
+                auto k = idx - startpos[sd];
+                auto shift = (k & 3) * 2;
+                auto& b = pBuf[sd][k >> 2];
+                b = (char)((b & ~(3 << shift)) | ((cell & 3) << shift));
+                return true;
+            }
+            return false;
+        }
+
         bool    setBuf2Bytes(i64 idx, int score, bslib::Side side) {
             auto sd = static_cast<int>(side);
             if (pBuf[sd] && idx >= startpos[sd] && idx < endpos[sd]) {
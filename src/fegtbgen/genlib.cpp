@@ -26,7 +26,8 @@
 #include <chrono>
 
 #include <random>
-#include <cmath>
+#include <cmath>
+#include <cstring>
 
 // for scaning files from a given path
 #ifdef _WIN32
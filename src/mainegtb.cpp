@@ -20,8 +20,12 @@
 #include <map>
 #include <algorithm>
 #include <iomanip>
+#include <string.h>
 
 #include "fegtb/egtbdb.h"
+#include "fegtb/egtbserver.h"
+#include "fegtb/egtbbatch.h"
+#include "fegtb/egtbbench.h"
 #include "base/funcs.h"
 
 #include "fegtbgen/egtbgendb.h"
@@ -64,9 +68,29 @@ static void show_usage(std::string name)
     << "  -d FOLDER    Egtb data folder, default is egtb inside program folder\n"
     << "  -d2 FOLDER   Second egtb data folder, for comparing, converting\n"
     << "  -verbose     Verbose - print more information\n"
+    << "  -stats       Print counters of probing (JSON) after probing -fen, -fenfile, -batch\n"
+    << "  -reindex     Write the manifest of folder -d (list of files for fast loading)\n"
+    << "  -hugepages   Use transparent huge pages for large buffers\n"
+    << "  -hugetlb     Use reserved huge pages for large buffers (transparent ones if failed)\n"
+    << "  -numa N      NUMA node for large buffers, or \"interleave\" to spread them over all nodes\n"
+    << "  -serve PATH  Serve probes on unix domain socket PATH, or on stdin/stdout if PATH is -\n"
+    << "  -sharedcache NAME  Share decompressed blocks with other processes via POSIX shared memory NAME\n"
+    << "  -batch FILE  Probe FEN/EPD lines (binary positions if FILE ends with .bin) of FILE in parallel, - for stdin (text)\n"
+    << "  -out FILE    Output of -batch: CSV (fen,score,wdl) or i32 scores if FILE ends with .bin, default - for stdout\n"
+    << "  -benchprobe N|FILE  Benchmark probing N random positions of each table, or positions of FILE,\n"
+    << "               under all memory modes with 1, 2, 4 ... -core threads, cold and warm caches\n"
     << "\n"
     << "  -g           Generate\n"
     << "  -notempfiles Not using temporary files\n"
+    << "  -flattable   Write flat compress tables (readable by old versions) instead of two-level ones\n"
+    << "  -fastcodec   Compress blocks by the lz codec: larger files but much faster decoding than lzma\n"
+    << "  -dict        Compress blocks by the lz codec with a dictionary trained for each table\n"
+    << "  -grammar     Compress blocks by a grammar with Huffman codes, probes decode items without whole blocks\n"
+    << "  -blocksize N Size of compress blocks in KB, a power of two from 1 to 64, default 4\n"
+    << "  -dontcare    Fill illegal cells to compress better, they won't be probed as illegal anymore\n"
+    << "               (legal but unreachable positions are not detected, they keep their scores)\n"
+    << "  -recompress  Rewrite existing tables with the compress options above\n"
+    << "  -blockreport Report compress ratios and decoding times of tables for all block sizes\n"
 //    << "  -c           Compare (need another folder d2)\n"
 //    << "  -maxsize     Max index size of endgames in Giga (\"-maxsize 8\" means 8 G indexes) for generating\n"
 //    << "  -minset      Min set of sub endgames for generating / showing\n"
@@ -74,6 +98,7 @@ static void show_usage(std::string name)
 //    << "  -unzip       Uncompress endgames (create .xtb files)\n"
     << "  -v           Verify endgames (exact name or attack pieces such as ch, r-h)\n"
     << "  -vkey        Verify keys (boards <-> indeces)\n"
+    << "  -wdl         Create WDL (win/draw/loss) tables from DTM ones\n"
 //    << "  -speed       Test speed\n"
     << "  -2           2 bytes per item\n"
     << "  -noverify    Turn off verifying\n"
@@ -86,6 +111,10 @@ static void show_usage(std::string name)
     << "  " << name << " -d d:\\mainegtb -fen K7/8/7k/8/8/1Rp5/8/8 w - - 0 2\n"
     << "  " << name << " -n kqrkrn -v\n"
     << "  " << name << " -n 2 -vkey\n"
+    << "  " << name << " -n 2 -d d:\\mainegtb -wdl\n"
+    << "  " << name << " -d d:\\mainegtb -serve /tmp/fegtb.sock -core 8\n"
+    << "  " << name << " -d d:\\mainegtb -batch positions.epd -out labels.csv -core 8\n"
+    << "  " << name << " -d d:\\mainegtb -benchprobe 10000 -core 8\n"
     << "  " << name << " -n rn -v\n"
     << "  " << name << " -n r-n -v\n"
 #else
@@ -93,6 +122,7 @@ static void show_usage(std::string name)
     << "  " << name << " -n 2 -vkey\n"
     << "  " << name << " -n kraabbkaabb -d d:\\mainegtb -g\n"
     << "  " << name << " -n 1 -d d:\\mainegtb -g -core 4\n"
+    << "  " << name << " -d d:\\mainegtb -serve -\n"
     << "  " << name << " -d d:\\mainegtb -fen 3ak4/4a4/9/9/9/9/n8/3AK4/9/3A5 b 0 0\n"
     << "  " << name << " -n kraaeekaaee -v\n"
     << "  " << name << " -n rn -v\n"
@@ -193,6 +223,22 @@ int main(int argc, char* argv[])
 #endif
     
     static const auto programName = "egtbgen";
+
+    /// stdout may be the channel of the probe server or the output of batch probing, messages go to stderr
+    auto argValue = [argc, argv](const char* name) -> const char* {
+        for (auto i = 1; i + 1 < argc; i++) {
+            if (strcmp(argv[i], name) == 0) {
+                return argv[i + 1];
+            }
+        }
+        return nullptr;
+    };
+    auto serving = argValue("-serve") != nullptr;
+    auto batchOut = argValue("-out");
+    if (serving || (argValue("-batch") && (!batchOut || strcmp(batchOut, "-") == 0))) {
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
     std::cout << "Felicity EGTB generator for " << EGTB_MAJOR_VARIANT
     << ", by Nguyen Hong Pham 2024, version: " << EGTB_VERSION_STRING
     << "\n" << std::endl;
@@ -218,7 +264,8 @@ int main(int argc, char* argv[])
         if (arg == "-core" || arg == "-ram" || arg == "-n" || arg == "-fen" || arg == "-fenfile" 
             || arg == "-d" || arg == "-d2" || arg == "-epd"
             || arg == "-test"
-            || arg == "-maxsize" || arg == "-perft") {
+            || arg == "-maxsize" || arg == "-perft" || arg == "-numa" || arg == "-blocksize" || arg == "-serve" || arg == "-sharedcache"
+            || arg == "-batch" || arg == "-out" || arg == "-benchprobe") {
             if (i + 1 < argc) {
                 i++;
                 str = argv[i];
@@ -308,6 +355,50 @@ int main(int argc, char* argv[])
     }
     
     egtbVerbose = argmap.find("-verbose") != argmap.end();
+    egtbStats = argmap.find("-stats") != argmap.end();
+
+    if (argmap.find("-hugepages") != argmap.end()) {
+        egtbMemPolicy.hugePages = EgtbHugePages::transparent;
+    }
+    if (argmap.find("-hugetlb") != argmap.end()) {
+        egtbMemPolicy.hugePages = EgtbHugePages::reserved;
+    }
+    if (argmap.find("-numa") != argmap.end()) {
+        auto s = argmap["-numa"];
+        egtbMemPolicy.numaNode = s == "interleave" ? -2 : std::atoi(s.c_str());
+    }
+
+    if (argmap.find("-reindex") != argmap.end()) {
+        EgtbDb::writeManifest(egtbFolder);
+        return 1;
+    }
+
+    if (serving) {
+        EgtbDb egtbDb;
+        if (argmap.find("-core") != argmap.end()) {
+            egtbDb.setProbeThreads(std::max(0, std::atoi(argmap["-core"].c_str()) - 1));
+        }
+        if (argmap.find("-sharedcache") != argmap.end()) {
+            egtbDb.openSharedCache(argmap["-sharedcache"]);
+        }
+        egtbDb.preload(egtbFolder, EgtbMemMode::tiny);
+
+        EgtbServer server(egtbDb);
+        auto path = argmap["-serve"];
+        auto r = path == "-" ? server.serveStream(0, 1) : server.serveSocket(path);
+        return r ? 0 : 1;
+    }
+
+    if (argmap.find("-benchprobe") != argmap.end()) {
+        auto str = argmap["-benchprobe"];
+        EgtbProbeBench bench(egtbFolder);
+        auto ok = Funcs::is_integer(str) ? bench.createWorkload(std::max(1, std::atoi(str.c_str()))) : bench.loadWorkload(str);
+        if (ok) {
+            auto threadCnt = argmap.find("-core") != argmap.end() ? std::atoi(argmap["-core"].c_str()) : (int)std::thread::hardware_concurrency();
+            bench.run(std::max(1, threadCnt));
+        }
+        return ok ? 0 : 1;
+    }
     
     if (argmap.find("-genforward") != argmap.end()) {
         EgtbGenDb::useBackward = false;
@@ -316,6 +407,28 @@ int main(int argc, char* argv[])
     if (argmap.find("-maxsize") != argmap.end()) {
         EgtbGenDb::maxEndgameSize = std::atoi(argmap["-maxsize"].c_str()) * 1024LL * 1024LL * 1024LL;
     }
+    if (argmap.find("-flattable") != argmap.end()) {
+        EgtbGenDb::twoLevelCompressTable = false;
+    }
+    if (argmap.find("-fastcodec") != argmap.end()) {
+        EgtbGenDb::codec = EgtbCodec::lz;
+    }
+    if (argmap.find("-dict") != argmap.end()) {
+        EgtbGenDb::codec = EgtbCodec::lz;
+        EgtbGenDb::dictSize = 16 * 1024;
+    }
+    if (argmap.find("-grammar") != argmap.end()) {
+        EgtbGenDb::codec = EgtbCodec::grammar;
+    }
+    auto compressMode = argmap.find("-dontcare") != argmap.end() ? CompressMode::compress_optimizing : CompressMode::compress;
+    if (argmap.find("-blocksize") != argmap.end()) {
+        auto kb = std::atoi(argmap["-blocksize"].c_str());
+        if (kb < 1 || kb > 64 || (kb & (kb - 1)) != 0) {
+            std::cerr << "Error: block size must be a power of two from 1 to 64 (KB)" << std::endl;
+            return -1;
+        }
+        EgtbGenDb::compressBlockSize = kb * 1024;
+    }
     if (argmap.find("-noverify") != argmap.end()) {
         EgtbGenDb::verifyMode = false;
     }
@@ -337,10 +450,14 @@ int main(int argc, char* argv[])
 	EgtbBoard board;
 
     auto showInfo = false;
-    if (argmap.find("-i") != argmap.end() || argmap.find("-fen") != argmap.end() || argmap.find("-fenfile") != argmap.end()) {
+    if (argmap.find("-i") != argmap.end() || argmap.find("-fen") != argmap.end() || argmap.find("-fenfile") != argmap.end()
+        || argmap.find("-batch") != argmap.end()) {
         showInfo = true;
 
         EgtbDb egtbDb;
+        if (argmap.find("-sharedcache") != argmap.end()) {
+            egtbDb.openSharedCache(argmap["-sharedcache"]);
+        }
         egtbDb.preload(egtbFolder, EgtbMemMode::tiny);
 
 		if (argmap.find("-i") != argmap.end()) {
@@ -358,7 +475,26 @@ int main(int argc, char* argv[])
 			auto fenString = argmap["-fen"];
             auto allMoveScores = argmap.find("-allmovescores") != argmap.end();
             probeFen(egtbDb, fenString, allMoveScores);
+            if (egtbStats) {
+                std::cout << egtbDb.getStatsJson() << std::endl;
+            }
 			return 1;
+        } else if (argmap.find("-batch") != argmap.end()) {
+            auto formatOf = [](const std::string& path) {
+                return Funcs::endsWith(path, ".bin") ? EgtbBatchFormat::binary : EgtbBatchFormat::text;
+            };
+            auto inPath = argmap["-batch"];
+            auto outPath = argmap.find("-out") != argmap.end() ? argmap["-out"] : "-";
+
+            EgtbBatchProber prober(egtbDb);
+            if (argmap.find("-core") != argmap.end()) {
+                prober.setThreadCount(std::atoi(argmap["-core"].c_str()));
+            }
+            auto r = prober.run(inPath, formatOf(inPath), outPath, formatOf(outPath));
+            if (egtbStats) {
+                std::cout << egtbDb.getStatsJson() << std::endl;
+            }
+            return r ? 0 : 1;
         } else {
             auto fileName = argmap["-fenfile"];
             auto array = GenLib::readFileToLineArray(fileName);
@@ -368,6 +504,9 @@ int main(int argc, char* argv[])
                     probeFen(egtbDb, fenString, argmap.find("-allmovescores") != argmap.end());
                 }
             }
+            if (egtbStats) {
+                std::cout << egtbDb.getStatsJson() << std::endl;
+            }
             return 1;
 		}
     }
@@ -439,7 +578,8 @@ int main(int argc, char* argv[])
 
         egtbGenFileMng.preload(egtbFolder, EgtbMemMode::all);
 
-        egtbGenFileMng.gen_all(egtbFolder, endgameName, EgtbType::dtm, CompressMode::compress);
+        egtbGenFileMng.gen_all(egtbFolder, endgameName, EgtbType::dtm, compressMode);
+        EgtbDb::writeManifest(egtbFolder);
         return 1;
     }
 
@@ -481,6 +621,25 @@ int main(int argc, char* argv[])
         return 1;
     }
     
+    if (argmap.find("-wdl") != argmap.end()) {
+        EgtbGenDb egtbGenFileMng;
+        egtbGenFileMng.preload(egtbFolder, EgtbMemMode::all);
+        egtbGenFileMng.createWDL(nameVec);
+        EgtbDb::writeManifest(egtbFolder);
+        return 1;
+    }
+
+    if (argmap.find("-recompress") != argmap.end() || argmap.find("-blockreport") != argmap.end()) {
+        auto reportOnly = argmap.find("-recompress") == argmap.end();
+        EgtbGenDb egtbGenFileMng;
+        egtbGenFileMng.preload(egtbFolder, EgtbMemMode::all);
+        egtbGenFileMng.recompress(nameVec, reportOnly, compressMode);
+        if (!reportOnly) {
+            EgtbDb::writeManifest(egtbFolder);
+        }
+        return 1;
+    }
+
     if (argmap.find("-vkey") != argmap.end()) {
         EgtbGenDb egtbGenFileMng;
         egtbGenFileMng.verifyKeys(nameVec);
@@ -499,7 +658,7 @@ bool probeFen(EgtbDb& egtbDb, const std::string& fenString, bool allMoveScores)
         
         auto score = egtbDb.getScore(board);
         auto idx = egtbDb.getKey(board);
-        std::cout << "score: " << score << ", explaination: " << explainScore(score) << ", idx: " << idx << std::endl;
+        std::cout << "score: " << score << ", explaination: " << explainScore(score) << ", idx: " << idx << ", wdl: " << egtbDb.getWDL(board) << std::endl;
         
         if (allMoveScores) {
             auto side = board.side, xside = getXSide(side);
@@ -57,6 +57,7 @@ XqBoard::XqBoard(ChessVariant _variant)
 
 XqBoard::XqBoard(const XqBoard& other)
 {
+    variant = other.variant;
     clone(&other);
 }
 